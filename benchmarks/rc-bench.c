@@ -0,0 +1,716 @@
+/*-
+ * Copyright (c) 2026 The Xfce development team
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Microbenchmarks of the XfceRc hot paths.
+ *
+ * Generates a synthetic rc or .desktop file of the requested shape in a
+ * temporary directory, times the common operations on it and prints one
+ * JSON object per operation and line, so results of different releases can
+ * be compared by a script. Run all of them with "meson benchmark".
+ *
+ * The plain open benchmarks open the same, unchanged file again and again,
+ * so after the first two opens the read-only ones only measure the lookup
+ * in the in-process image cache. The "_cold" variants change the
+ * modification time of the files before every open, which invalidates the
+ * images, so they measure a full parse.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+#include <stdio.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include "libxfce4util/libxfce4util.h"
+
+
+
+#define RESOURCE "rc-bench/bench.rc"
+
+typedef struct _Bench Bench;
+typedef guint (*BenchFunc) (Bench *bench);
+
+struct _Bench
+{
+  /* the shape of the generated file */
+  const gchar *kind;
+  gint n_groups;
+  gint n_keys;
+  gint n_locales;
+  gint value_length;
+
+  /* minimum run time of each benchmark in microseconds */
+  gint64 min_time;
+
+  gchar *dir;
+  gchar *filename;
+  gchar *flush_filename;
+  gsize file_size;
+
+  /* the files of the config handles, most important last */
+  GPtrArray *config_filenames;
+
+  /* the names of all groups in the file, in file order */
+  GPtrArray *groups;
+  GPtrArray *keys;
+
+  /* handles used by the benchmarks that do not open files */
+  XfceRc *rc_ro;
+  XfceRc *rc_rw;
+  XfceRc *rc_config;
+  XfceRc *rc_flush;
+  guint serial;
+
+  /* entries found by the read benchmarks, so they are not optimized away */
+  guint64 n_found;
+};
+
+
+
+/* a few real locales, so locale matching behaves like it does in the wild */
+static const gchar *locales[] = {
+  "af", "ar", "ast", "be", "bg", "ca", "cs", "da", "de", "el", "en_AU", "en_GB",
+  "eo", "es", "et", "eu", "fi", "fr", "gl", "he", "hr", "hu", "id", "is", "it",
+  "ja", "kk", "ko", "lt", "lv", "ms", "nb", "nl", "nn", "oc", "pl", "pt", "pt_BR",
+  "ro", "ru", "sk", "sl", "sq", "sr", "sv", "th", "tr", "ug", "uk", "vi", "zh_CN",
+  "zh_HK", "zh_TW",
+};
+
+/* the translated keys of a .desktop file */
+static const gchar *desktop_keys[] = {
+  "Name", "GenericName", "Comment", "Keywords",
+};
+
+static gchar *opt_kind = NULL;
+static gint opt_groups = 8;
+static gint opt_keys = 16;
+static gint opt_locales = 4;
+static gint opt_value_length = 32;
+static gint opt_min_time = 200;
+static gchar *opt_filter = NULL;
+
+static GOptionEntry option_entries[] = {
+  { "kind", 0, 0, G_OPTION_ARG_STRING, &opt_kind, "Kind of file to generate, \"rc\" or \"desktop\"", "KIND" },
+  { "groups", 0, 0, G_OPTION_ARG_INT, &opt_groups, "Number of groups", "N" },
+  { "keys", 0, 0, G_OPTION_ARG_INT, &opt_keys, "Number of keys per group", "N" },
+  { "locales", 0, 0, G_OPTION_ARG_INT, &opt_locales, "Number of translations per key", "N" },
+  { "value-length", 0, 0, G_OPTION_ARG_INT, &opt_value_length, "Length of every value", "N" },
+  { "min-time", 0, 0, G_OPTION_ARG_INT, &opt_min_time, "Minimum run time of each benchmark in milliseconds", "MS" },
+  { "filter", 0, 0, G_OPTION_ARG_STRING, &opt_filter, "Only run the benchmarks whose name contains this", "TEXT" },
+  G_OPTION_ENTRY_NULL,
+};
+
+
+
+static void
+append_value (GString *contents,
+              gint length,
+              guint seed)
+{
+  gint n;
+
+  for (n = 0; n < length; ++n)
+    {
+      /* a space every now and then, like in real text */
+      if (n % 8 == 7)
+        g_string_append_c (contents, ' ');
+      else
+        g_string_append_c (contents, 'a' + (seed + n) % 26);
+    }
+  g_string_append_c (contents, '\n');
+}
+
+
+
+static void
+append_entry (GString *contents,
+              const Bench *bench,
+              const gchar *key,
+              gboolean translated,
+              guint seed)
+{
+  gint n;
+
+  g_string_append_printf (contents, "%s=", key);
+  append_value (contents, bench->value_length, seed);
+
+  if (!translated)
+    return;
+
+  for (n = 0; n < bench->n_locales; ++n)
+    {
+      g_string_append_printf (contents, "%s[%s]=", key, locales[n % G_N_ELEMENTS (locales)]);
+      append_value (contents, bench->value_length, seed + n + 1);
+    }
+}
+
+
+
+/* @n_groups groups of @n_keys translated keys each */
+static GString *
+generate_rc (Bench *bench,
+             guint seed)
+{
+  GString *contents;
+  gint g;
+  gint k;
+
+  contents = g_string_sized_new (4096);
+  for (g = 0; g < bench->n_groups; ++g)
+    {
+      g_string_append_printf (contents, "[%s]\n", (const gchar *) g_ptr_array_index (bench->groups, g));
+      for (k = 0; k < bench->n_keys; ++k)
+        append_entry (contents, bench, g_ptr_array_index (bench->keys, k), TRUE, seed + g * bench->n_keys + k);
+      g_string_append_c (contents, '\n');
+    }
+
+  return contents;
+}
+
+
+
+/* a [Desktop Entry] with the usual translated and untranslated keys and
+ * custom ones up to @n_keys, followed by @n_groups - 1 desktop actions */
+static GString *
+generate_desktop (Bench *bench,
+                  guint seed)
+{
+  GString *contents;
+  gint g;
+  gint k;
+
+  contents = g_string_sized_new (4096);
+  g_string_append_printf (contents, "[%s]\n", (const gchar *) g_ptr_array_index (bench->groups, 0));
+  g_string_append (contents, "Version=1.0\nType=Application\nTerminal=false\nStartupNotify=true\n");
+  for (k = 0; k < bench->n_keys; ++k)
+    append_entry (contents, bench, g_ptr_array_index (bench->keys, k),
+                  k < (gint) G_N_ELEMENTS (desktop_keys), seed + k);
+
+  for (g = 1; g < bench->n_groups; ++g)
+    {
+      g_string_append_printf (contents, "\n[%s]\n", (const gchar *) g_ptr_array_index (bench->groups, g));
+      append_entry (contents, bench, "Name", TRUE, seed + g);
+      append_entry (contents, bench, "Exec", FALSE, seed + g);
+    }
+
+  return contents;
+}
+
+
+
+static GString *
+generate (Bench *bench,
+          guint seed)
+{
+  if (g_strcmp0 (bench->kind, "desktop") == 0)
+    return generate_desktop (bench, seed);
+
+  return generate_rc (bench, seed);
+}
+
+
+
+static void
+write_file (const gchar *filename,
+            const GString *contents)
+{
+  GError *error = NULL;
+  gchar *dir;
+
+  dir = g_path_get_dirname (filename);
+  if (g_mkdir_with_parents (dir, 0700) < 0
+      || !g_file_set_contents (filename, contents->str, contents->len, &error))
+    {
+      g_printerr ("rc-bench: Unable to write %s: %s\n", filename,
+                  error != NULL ? error->message : g_strerror (errno));
+      exit (EXIT_FAILURE);
+    }
+  g_free (dir);
+}
+
+
+
+/* a new modification time, so the next open cannot use a cached image */
+static void
+touch_file (const gchar *filename,
+            guint64 mtime)
+{
+  GFile *file;
+
+  file = g_file_new_for_path (filename);
+  g_file_set_attribute_uint64 (file, G_FILE_ATTRIBUTE_TIME_MODIFIED, mtime,
+                               G_FILE_QUERY_INFO_NONE, NULL, NULL);
+  g_object_unref (file);
+}
+
+
+
+static void
+bench_setup (Bench *bench)
+{
+  GString *contents;
+  gchar *config_dirs;
+  gchar *filename;
+  gint n;
+
+  bench->dir = g_dir_make_tmp ("rc-bench-XXXXXX", NULL);
+  if (bench->dir == NULL)
+    {
+      g_printerr ("rc-bench: Unable to create a temporary directory\n");
+      exit (EXIT_FAILURE);
+    }
+
+  /* the resource lookups read the environment only once, so this has to
+   * happen before the first config handle is opened */
+  filename = g_build_filename (bench->dir, "user", NULL);
+  config_dirs = g_strdup_printf ("%s/sys1:%s/sys2", bench->dir, bench->dir);
+  g_setenv ("XDG_CONFIG_HOME", filename, TRUE);
+  g_setenv ("XDG_CONFIG_DIRS", config_dirs, TRUE);
+  g_free (config_dirs);
+  g_free (filename);
+
+  /* the disk cache would turn the open benchmarks into cache lookups */
+  g_unsetenv ("XFCE4UTIL_RC_CACHE");
+
+  /* look up the translation in the middle of each entry */
+  if (bench->n_locales > 0)
+    g_setenv ("LANGUAGE", locales[bench->n_locales / 2], TRUE);
+  else
+    g_unsetenv ("LANGUAGE");
+
+  bench->groups = g_ptr_array_new_with_free_func (g_free);
+  bench->keys = g_ptr_array_new_with_free_func (g_free);
+  for (n = 0; n < bench->n_groups; ++n)
+    {
+      if (g_strcmp0 (bench->kind, "desktop") != 0)
+        g_ptr_array_add (bench->groups, g_strdup_printf ("Group %d", n));
+      else if (n == 0)
+        g_ptr_array_add (bench->groups, g_strdup ("Desktop Entry"));
+      else
+        g_ptr_array_add (bench->groups, g_strdup_printf ("Desktop Action action%d", n));
+    }
+  for (n = 0; n < bench->n_keys; ++n)
+    {
+      if (g_strcmp0 (bench->kind, "desktop") == 0 && n < (gint) G_N_ELEMENTS (desktop_keys))
+        g_ptr_array_add (bench->keys, g_strdup (desktop_keys[n]));
+      else
+        g_ptr_array_add (bench->keys, g_strdup_printf ("Key%d", n));
+    }
+
+  /* the file for the simple handles, which is also the system layer of
+   * the config handles, with a user layer that overrides some values */
+  bench->config_filenames = g_ptr_array_new_with_free_func (g_free);
+
+  contents = generate (bench, 0);
+  bench->filename = g_build_filename (bench->dir, "sys1", RESOURCE, NULL);
+  bench->file_size = contents->len;
+  write_file (bench->filename, contents);
+  g_string_free (contents, TRUE);
+  g_ptr_array_add (bench->config_filenames, g_strdup (bench->filename));
+
+  contents = generate (bench, 7);
+  filename = g_build_filename (bench->dir, "sys2", RESOURCE, NULL);
+  write_file (filename, contents);
+  g_string_free (contents, TRUE);
+  g_ptr_array_add (bench->config_filenames, filename);
+
+  contents = generate (bench, 13);
+  filename = g_build_filename (bench->dir, "user", RESOURCE, NULL);
+  write_file (filename, contents);
+  g_string_free (contents, TRUE);
+  g_ptr_array_add (bench->config_filenames, filename);
+
+  bench->flush_filename = g_build_filename (bench->dir, "flush.rc", NULL);
+
+  bench->rc_ro = xfce_rc_simple_open (bench->filename, TRUE);
+  bench->rc_rw = xfce_rc_simple_open (bench->filename, FALSE);
+  bench->rc_config = xfce_rc_config_open (XFCE_RESOURCE_CONFIG, RESOURCE, TRUE);
+  bench->rc_flush = xfce_rc_simple_open (bench->flush_filename, FALSE);
+  if (bench->rc_ro == NULL || bench->rc_rw == NULL
+      || bench->rc_config == NULL || bench->rc_flush == NULL)
+    {
+      g_printerr ("rc-bench: Unable to open the generated files in %s\n", bench->dir);
+      exit (EXIT_FAILURE);
+    }
+}
+
+
+
+static void
+remove_recursive (const gchar *path)
+{
+  const gchar *name;
+  gchar *child;
+  GDir *dir;
+
+  dir = g_dir_open (path, 0, NULL);
+  if (dir != NULL)
+    {
+      while ((name = g_dir_read_name (dir)) != NULL)
+        {
+          child = g_build_filename (path, name, NULL);
+          remove_recursive (child);
+          g_free (child);
+        }
+      g_dir_close (dir);
+    }
+
+  g_remove (path);
+}
+
+
+
+static void
+bench_teardown (Bench *bench)
+{
+  xfce_rc_close (bench->rc_ro);
+
+  /* the writes are not meant to end up in the file */
+  xfce_rc_rollback (bench->rc_rw);
+  xfce_rc_close (bench->rc_rw);
+  xfce_rc_close (bench->rc_config);
+  xfce_rc_close (bench->rc_flush);
+
+  remove_recursive (bench->dir);
+
+  g_ptr_array_unref (bench->groups);
+  g_ptr_array_unref (bench->keys);
+  g_ptr_array_unref (bench->config_filenames);
+  g_free (bench->flush_filename);
+  g_free (bench->filename);
+  g_free (bench->dir);
+}
+
+
+
+static guint
+bench_simple_open_ro (Bench *bench)
+{
+  xfce_rc_close (xfce_rc_simple_open (bench->filename, TRUE));
+  return 1;
+}
+
+
+
+static guint
+bench_simple_open_ro_cold (Bench *bench)
+{
+  touch_file (bench->filename, bench->serial++);
+  xfce_rc_close (xfce_rc_simple_open (bench->filename, TRUE));
+  return 1;
+}
+
+
+
+static guint
+bench_simple_open_rw (Bench *bench)
+{
+  xfce_rc_close (xfce_rc_simple_open (bench->filename, FALSE));
+  return 1;
+}
+
+
+
+static guint
+bench_config_open_ro (Bench *bench)
+{
+  xfce_rc_close (xfce_rc_config_open (XFCE_RESOURCE_CONFIG, RESOURCE, TRUE));
+  return 1;
+}
+
+
+
+static guint
+bench_config_open_ro_cold (Bench *bench)
+{
+  guint n;
+
+  for (n = 0; n < bench->config_filenames->len; ++n)
+    touch_file (g_ptr_array_index (bench->config_filenames, n), bench->serial);
+  bench->serial++;
+
+  xfce_rc_close (xfce_rc_config_open (XFCE_RESOURCE_CONFIG, RESOURCE, TRUE));
+  return 1;
+}
+
+
+
+static gboolean
+count_entry (const gchar *key,
+             const gchar *value,
+             gpointer user_data)
+{
+  Bench *bench = user_data;
+
+  bench->n_found++;
+  return TRUE;
+}
+
+
+
+static gboolean
+count_locale_entry (const gchar *key,
+                    const gchar *locale,
+                    const gchar *value,
+                    gpointer user_data)
+{
+  Bench *bench = user_data;
+
+  bench->n_found++;
+  return TRUE;
+}
+
+
+
+static guint
+bench_parse_file (Bench *bench)
+{
+  XfceRcParser parser = { NULL, count_entry, count_locale_entry, { NULL } };
+
+  xfce_rc_parse_file (bench->filename, &parser, bench, NULL);
+  return 1;
+}
+
+
+
+static guint
+bench_config_open_rw (Bench *bench)
+{
+  xfce_rc_close (xfce_rc_config_open (XFCE_RESOURCE_CONFIG, RESOURCE, FALSE));
+  return 1;
+}
+
+
+
+static guint
+read_all (Bench *bench,
+          XfceRc *rc,
+          gboolean translated)
+{
+  const gchar *value;
+  guint g;
+  guint k;
+
+  for (g = 0; g < bench->groups->len; ++g)
+    {
+      xfce_rc_set_group (rc, g_ptr_array_index (bench->groups, g));
+      for (k = 0; k < bench->keys->len; ++k)
+        {
+          if (translated)
+            value = xfce_rc_read_entry (rc, g_ptr_array_index (bench->keys, k), NULL);
+          else
+            value = xfce_rc_read_entry_untranslated (rc, g_ptr_array_index (bench->keys, k), NULL);
+          if (value != NULL)
+            bench->n_found++;
+        }
+    }
+
+  return bench->groups->len * bench->keys->len;
+}
+
+
+
+static guint
+bench_read_entry (Bench *bench)
+{
+  return read_all (bench, bench->rc_ro, TRUE);
+}
+
+
+
+static guint
+bench_read_entry_untranslated (Bench *bench)
+{
+  return read_all (bench, bench->rc_ro, FALSE);
+}
+
+
+
+static guint
+bench_config_read_entry (Bench *bench)
+{
+  return read_all (bench, bench->rc_config, TRUE);
+}
+
+
+
+static guint
+bench_config_read_entry_untranslated (Bench *bench)
+{
+  return read_all (bench, bench->rc_config, FALSE);
+}
+
+
+
+static guint
+bench_get_groups (Bench *bench)
+{
+  g_strfreev (xfce_rc_get_groups (bench->rc_ro));
+  return 1;
+}
+
+
+
+static guint
+bench_get_entries (Bench *bench)
+{
+  guint g;
+
+  for (g = 0; g < bench->groups->len; ++g)
+    g_strfreev (xfce_rc_get_entries (bench->rc_ro, g_ptr_array_index (bench->groups, g)));
+
+  return bench->groups->len;
+}
+
+
+
+static guint
+bench_write_entry (Bench *bench)
+{
+  gchar value[32];
+  guint g;
+  guint k;
+
+  /* a new value every time, so the entries really change */
+  g_snprintf (value, sizeof (value), "value %u", bench->serial++);
+
+  for (g = 0; g < bench->groups->len; ++g)
+    {
+      xfce_rc_set_group (bench->rc_rw, g_ptr_array_index (bench->groups, g));
+      for (k = 0; k < bench->keys->len; ++k)
+        xfce_rc_write_entry (bench->rc_rw, g_ptr_array_index (bench->keys, k), value);
+    }
+
+  return bench->groups->len * bench->keys->len;
+}
+
+
+
+static guint
+bench_flush (Bench *bench)
+{
+  xfce_rc_write_int_entry (bench->rc_flush, "Serial", bench->serial++);
+  xfce_rc_flush (bench->rc_flush);
+  return 1;
+}
+
+
+
+static void
+bench_run (Bench *bench,
+           const gchar *name,
+           BenchFunc func)
+{
+  gint64 start;
+  gint64 elapsed;
+  guint64 ops = 0;
+  guint iterations = 0;
+
+  if (opt_filter != NULL && strstr (name, opt_filter) == NULL)
+    return;
+
+  /* warm up caches and lazily built indexes */
+  (*func) (bench);
+
+  start = g_get_monotonic_time ();
+  do
+    {
+      ops += (*func) (bench);
+      iterations++;
+      elapsed = g_get_monotonic_time () - start;
+    }
+  while (elapsed < bench->min_time);
+
+  printf ("{\"benchmark\": \"%s\", \"kind\": \"%s\", \"groups\": %d, \"keys\": %d, "
+          "\"locales\": %d, \"value_length\": %d, \"file_size\": %" G_GSIZE_FORMAT ", "
+          "\"iterations\": %u, \"ops\": %" G_GUINT64_FORMAT ", \"ns_per_op\": %.1f}\n",
+          name, bench->kind, bench->n_groups, bench->n_keys, bench->n_locales,
+          bench->value_length, bench->file_size, iterations, ops,
+          (gdouble) elapsed * 1000.0 / (gdouble) ops);
+  fflush (stdout);
+}
+
+
+
+int
+main (int argc, char **argv)
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  Bench bench;
+
+  context = g_option_context_new ("- benchmark the XfceRc hot paths");
+  g_option_context_add_main_entries (context, option_entries, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("rc-bench: %s\n", error->message);
+      g_error_free (error);
+      return EXIT_FAILURE;
+    }
+  g_option_context_free (context);
+
+  if (opt_kind != NULL && strcmp (opt_kind, "rc") != 0 && strcmp (opt_kind, "desktop") != 0)
+    {
+      g_printerr ("rc-bench: Unknown kind \"%s\"\n", opt_kind);
+      return EXIT_FAILURE;
+    }
+
+  memset (&bench, 0, sizeof (bench));
+  bench.kind = (opt_kind != NULL) ? opt_kind : "rc";
+  bench.n_groups = MAX (opt_groups, 1);
+  bench.n_keys = MAX (opt_keys, g_strcmp0 (bench.kind, "desktop") == 0 ? (gint) G_N_ELEMENTS (desktop_keys) : 1);
+  bench.n_locales = CLAMP (opt_locales, 0, (gint) G_N_ELEMENTS (locales));
+  bench.value_length = MAX (opt_value_length, 0);
+  bench.min_time = (gint64) MAX (opt_min_time, 1) * 1000;
+
+  bench_setup (&bench);
+
+  bench_run (&bench, "simple_open_ro", bench_simple_open_ro);
+  bench_run (&bench, "simple_open_ro_cold", bench_simple_open_ro_cold);
+  bench_run (&bench, "simple_open_rw", bench_simple_open_rw);
+  bench_run (&bench, "config_open_ro", bench_config_open_ro);
+  bench_run (&bench, "config_open_ro_cold", bench_config_open_ro_cold);
+  bench_run (&bench, "config_open_rw", bench_config_open_rw);
+  bench_run (&bench, "parse_file", bench_parse_file);
+  bench_run (&bench, "read_entry", bench_read_entry);
+  bench_run (&bench, "read_entry_untranslated", bench_read_entry_untranslated);
+  bench_run (&bench, "config_read_entry", bench_config_read_entry);
+  bench_run (&bench, "config_read_entry_untranslated", bench_config_read_entry_untranslated);
+  bench_run (&bench, "get_groups", bench_get_groups);
+  bench_run (&bench, "get_entries", bench_get_entries);
+  bench_run (&bench, "write_entry", bench_write_entry);
+  bench_run (&bench, "flush", bench_flush);
+
+  bench_teardown (&bench);
+
+  return EXIT_SUCCESS;
+}
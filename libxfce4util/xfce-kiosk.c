@@ -70,14 +70,22 @@ struct _XfceKiosk
   GObject __parent__;
 
   gchar *module_name;
-  XfceRc *module_rc;
+
+  /* immutable copy of <module>.kioskrc, so lookups from different
+   * threads do not need a lock, and the group that was current after
+   * parsing it, i.e. the last one, which lookups read from */
+  XfceRcSnapshot *module_snapshot;
+  gchar *module_group;
 };
 
 
 static const gchar *
 xfce_kiosk_lookup (const XfceKiosk *kiosk,
+                   const XfceRcSnapshot *snapshot,
                    const gchar *capability);
 static gboolean
+xfce_kiosk_allowed (const gchar *value);
+static gboolean
 xfce_kiosk_chkgrp (const gchar *group);
 static time_t
 mtime (const gchar *path);
@@ -88,8 +96,10 @@ xfce_kiosk_finalize (GObject *object);
 static gchar *usrname = NULL;
 static gchar **groups;
 static time_t kiosktime = 0;
-static const gchar *kioskdef = NULL;
-static XfceRc *kioskrc = NULL;
+static gboolean kioskloaded = FALSE;
+
+/* immutable copy of kioskrc, queries take a reference under the lock */
+static XfceRcSnapshot *kiosksnapshot = NULL;
 
 G_DEFINE_FINAL_TYPE (XfceKiosk, xfce_kiosk, G_TYPE_OBJECT)
 G_LOCK_DEFINE_STATIC (kiosk_lock);
@@ -118,6 +128,7 @@ XfceKiosk *
 xfce_kiosk_new (const gchar *module)
 {
   XfceKiosk *kiosk;
+  XfceRc *rc;
   gchar path[1024];
 
   g_return_val_if_fail (module != NULL, NULL);
@@ -127,7 +138,14 @@ xfce_kiosk_new (const gchar *module)
 
   kiosk = g_object_new (XFCE_TYPE_KIOSK, NULL);
   kiosk->module_name = g_strdup (module);
-  kiosk->module_rc = xfce_rc_simple_open (path, TRUE);
+
+  rc = xfce_rc_simple_open (path, TRUE);
+  if (rc != NULL)
+    {
+      kiosk->module_snapshot = xfce_rc_get_snapshot (rc);
+      kiosk->module_group = g_strdup (xfce_rc_get_group (rc));
+      xfce_rc_close (rc);
+    }
 
   return kiosk;
 }
@@ -149,11 +167,8 @@ gboolean
 xfce_kiosk_query (const XfceKiosk *kiosk,
                   const gchar *capability)
 {
-  const gchar *value;
+  XfceRcSnapshot *snapshot;
   gboolean result;
-  gchar **vector;
-  gchar *string;
-  gint n;
 
   g_return_val_if_fail (kiosk != NULL, FALSE);
   g_return_val_if_fail (capability != NULL, FALSE);
@@ -161,7 +176,27 @@ xfce_kiosk_query (const XfceKiosk *kiosk,
   if (G_UNLIKELY (usrname == NULL))
     return FALSE;
 
-  value = xfce_kiosk_lookup (kiosk, capability);
+  /* kioskrc may be reloaded by xfce_kiosk_new() meanwhile */
+  G_LOCK (kiosk_lock);
+  snapshot = (kiosksnapshot != NULL) ? xfce_rc_snapshot_ref (kiosksnapshot) : NULL;
+  G_UNLOCK (kiosk_lock);
+
+  result = xfce_kiosk_allowed (xfce_kiosk_lookup (kiosk, snapshot, capability));
+
+  if (snapshot != NULL)
+    xfce_rc_snapshot_unref (snapshot);
+
+  return result;
+}
+
+
+static gboolean
+xfce_kiosk_allowed (const gchar *value)
+{
+  gboolean result;
+  gchar **vector;
+  gchar *string;
+  gint n;
 
   /* most common case first! */
   if (G_LIKELY (value[0] == 'A'
@@ -209,8 +244,9 @@ xfce_kiosk_finalize (GObject *object)
 
   g_return_if_fail (kiosk != NULL);
 
-  if (kiosk->module_rc != NULL)
-    xfce_rc_close (kiosk->module_rc);
+  if (kiosk->module_snapshot != NULL)
+    xfce_rc_snapshot_unref (kiosk->module_snapshot);
+  g_free (kiosk->module_group);
   g_free (kiosk->module_name);
 
   G_OBJECT_CLASS (xfce_kiosk_parent_class)->finalize (object);
@@ -237,31 +273,28 @@ xfce_kiosk_free (XfceKiosk *kiosk)
 
 static const gchar *
 xfce_kiosk_lookup (const XfceKiosk *kiosk,
+                   const XfceRcSnapshot *snapshot,
                    const gchar *capability)
 {
   const gchar *value;
 
-  if (G_UNLIKELY (kiosk->module_rc != NULL))
+  if (G_UNLIKELY (kiosk->module_snapshot != NULL))
     {
-      value = xfce_rc_read_entry (kiosk->module_rc, capability, NULL);
+      value = xfce_rc_snapshot_lookup (kiosk->module_snapshot, kiosk->module_group, capability, TRUE);
       if (value != NULL)
         return value;
     }
 
-  if (G_UNLIKELY (kioskrc != NULL))
+  if (G_UNLIKELY (snapshot != NULL))
     {
-      G_LOCK (kiosk_lock);
-
-      xfce_rc_set_group (kioskrc, kiosk->module_name);
-      value = xfce_rc_read_entry (kioskrc, capability, NULL);
-
-      G_UNLOCK (kiosk_lock);
-
+      value = xfce_rc_snapshot_lookup (snapshot, kiosk->module_name, capability, TRUE);
+      if (value == NULL)
+        value = xfce_rc_snapshot_lookup (snapshot, "General", "Default", TRUE);
       if (value != NULL)
         return value;
     }
 
-  return kioskdef;
+  return KIOSKDEF;
 }
 
 
@@ -288,26 +321,27 @@ xfce_kiosk_init (XfceKiosk *kiosk)
   int n;
   int m;
   time_t timestamp;
+  XfceRc *rc;
 
   G_LOCK (kiosk_lock);
 
-  /* reload kioskrc */
+  /* reload kioskrc, queries that still use the old snapshot keep it alive */
   timestamp = mtime (KIOSKRC);
-  if (timestamp > kiosktime || kioskdef == NULL)
+  if (timestamp > kiosktime || !kioskloaded)
     {
-      if (kioskrc != NULL)
-        xfce_rc_close (kioskrc);
-
-      kiosktime = timestamp;
-      kioskrc = xfce_rc_simple_open (KIOSKRC, TRUE);
-      if (kioskrc != NULL)
+      if (kiosksnapshot != NULL)
         {
-          xfce_rc_set_group (kioskrc, "General");
-          kioskdef = xfce_rc_read_entry (kioskrc, "Default", KIOSKDEF);
+          xfce_rc_snapshot_unref (kiosksnapshot);
+          kiosksnapshot = NULL;
         }
-      else
+
+      kiosktime = timestamp;
+      kioskloaded = TRUE;
+      rc = xfce_rc_simple_open (KIOSKRC, TRUE);
+      if (rc != NULL)
         {
-          kioskdef = KIOSKDEF;
+          kiosksnapshot = xfce_rc_get_snapshot (rc);
+          xfce_rc_close (rc);
         }
     }
 
@@ -0,0 +1,549 @@
+/*-
+ * Copyright (c) 2026 The Xfce development team
+ * All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Compiled rc images.
+ *
+ * When XFCE4UTIL_RC_CACHE is set in the environment, the contents of every
+ * parsed rc file are stored under $XDG_CACHE_HOME/libxfce4util/rc/ as a flat
+ * image: a fixed header that identifies the source file, followed by the
+ * records written by XfceRcSimple. The next open of the same, unchanged file
+ * maps the image and points its entries right into it instead of parsing
+ * the text again.
+ *
+ * An image is valid as long as the device, inode, size and modification
+ * time of the source file match the ones recorded in the header.
+ *
+ * The system files of xfce_rc_config_open() are read by almost every process
+ * of a session, so their images are stored below $XDG_RUNTIME_DIR/libxfce4util/rc/
+ * instead. Every process maps the same image read-only, so the pages holding
+ * the strings are shared, and only the first process parses the files.
+ *
+ * The environment of a process, and with it both directories, may be
+ * inherited from another user, e.g. with sudo -E. Images are therefore only
+ * read from and written to a directory owned by the effective user with
+ * mode 0700, and only mapped if they are owned by that user with mode 0600.
+ *
+ * Independent of that, the images of files opened read-only more than once,
+ * and of the system files of xfce_rc_config_open(), are kept in memory for
+ * the lifetime of the process, validated the same way, so opening the same
+ * file again only takes a stat() and a walk over the image. All handles of
+ * that file share its strings. The first open of any other file only leaves
+ * a note that it was seen, so files read once cost no image.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#ifdef HAVE_MEMORY_H
+#include <memory.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "xfce-private.h"
+#include "xfce-rc-private.h"
+#include "libxfce4util-visibility.h"
+
+
+
+#define CACHE_ENVVAR "XFCE4UTIL_RC_CACHE"
+#define CACHE_DIR "libxfce4util/rc/"
+
+/* "XRC" followed by the format version */
+#define CACHE_MAGIC 0x02435258
+
+/* the size of the SHA-256 digest of the source file */
+#define CACHE_DIGEST_LEN 32
+
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+#ifndef O_NOFOLLOW
+#define O_NOFOLLOW 0
+#endif
+
+/* limits of the in-memory cache, the oldest images are dropped first */
+#define MEMORY_CACHE_MAX_IMAGES 256
+#define MEMORY_CACHE_MAX_SIZE (4 * 1024 * 1024)
+
+
+typedef struct _CacheHeader CacheHeader;
+typedef struct _MemoryImage MemoryImage;
+
+
+
+struct _CacheHeader
+{
+  guint32 magic;
+  guint32 header_size;
+  guint64 dev;
+  guint64 ino;
+  guint64 size;
+  gint64 mtime;
+  gint64 mtime_nsec;
+  guint64 payload_len;
+
+  /* of the contents of the source file, only set in the images of
+   * writable handles, which need it to skip unchanged flushes */
+  guint8 digest[CACHE_DIGEST_LEN];
+};
+
+struct _MemoryImage
+{
+  /* filename and variant, the key of the image */
+  gchar *key;
+  XfceRcStamp stamp;
+
+  /* NULL if the file was only opened once so far */
+  GBytes *payload;
+};
+
+
+
+/* key -> MemoryImage, plus the images in the order they were stored */
+G_LOCK_DEFINE_STATIC (memory_cache);
+static GHashTable *memory_cache = NULL;
+static GQueue memory_cache_order = G_QUEUE_INIT;
+static gsize memory_cache_size = 0;
+
+
+
+static gchar *
+cache_get_path (const gchar *filename,
+                const gchar *variant,
+                gboolean shared,
+                gboolean create)
+{
+  GChecksum *checksum;
+  gchar *relpath;
+  gchar *path;
+  gchar *dir;
+
+  checksum = g_checksum_new (G_CHECKSUM_SHA1);
+  g_checksum_update (checksum, (const guchar *) filename, strlen (filename) + 1);
+  g_checksum_update (checksum, (const guchar *) variant, -1);
+  relpath = g_strconcat (CACHE_DIR, g_checksum_get_string (checksum), ".cache", NULL);
+  g_checksum_free (checksum);
+
+  if (!shared)
+    {
+      path = xfce_resource_save_location (XFCE_RESOURCE_CACHE, relpath, create);
+      g_free (relpath);
+      return path;
+    }
+
+  /* falls back to the cache directory if XDG_RUNTIME_DIR is not set */
+  path = g_build_filename (g_get_user_runtime_dir (), relpath, NULL);
+  g_free (relpath);
+
+  if (create)
+    {
+      dir = g_path_get_dirname (path);
+      if (g_mkdir_with_parents (dir, 0700) < 0)
+        {
+          g_free (path);
+          path = NULL;
+        }
+      g_free (dir);
+    }
+
+  return path;
+}
+
+
+
+/* whether @sb belongs to the effective user and has exactly @mode */
+static gboolean
+cache_is_private (const struct stat *sb,
+                  mode_t mode)
+{
+  return sb->st_uid == geteuid () && (sb->st_mode & 07777) == mode;
+}
+
+
+
+/* opens the directory of @path if it is private to the effective user */
+static gint
+cache_open_dir (const gchar *path)
+{
+  struct stat sb;
+  gchar *dir;
+  gint fd;
+
+  dir = g_path_get_dirname (path);
+  fd = open (dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  g_free (dir);
+
+  if (fd >= 0 && (fstat (fd, &sb) < 0 || !cache_is_private (&sb, 0700)))
+    {
+      close (fd);
+      return -1;
+    }
+
+  return fd;
+}
+
+
+
+/* opens the image at @path if it and its directory are private to the
+ * effective user, else anyone could feed us the entries of a file */
+static gint
+cache_open_image (const gchar *path)
+{
+  struct stat sb;
+  gchar *name;
+  gint dir_fd;
+  gint fd;
+
+  dir_fd = cache_open_dir (path);
+  if (dir_fd < 0)
+    return -1;
+
+  name = g_path_get_basename (path);
+  fd = openat (dir_fd, name, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+  g_free (name);
+  close (dir_fd);
+
+  if (fd >= 0
+      && (fstat (fd, &sb) < 0 || !S_ISREG (sb.st_mode) || !cache_is_private (&sb, 0600)))
+    {
+      close (fd);
+      return -1;
+    }
+
+  return fd;
+}
+
+
+
+gboolean
+_xfce_rc_cache_enabled (void)
+{
+  const gchar *value;
+
+  value = g_getenv (CACHE_ENVVAR);
+
+  return value != NULL && *value != '\0' && strcmp (value, "0") != 0;
+}
+
+
+
+gboolean
+_xfce_rc_stamp_init (XfceRcStamp *stamp,
+                     const gchar *filename)
+{
+  struct stat sb;
+
+  if (stat (filename, &sb) < 0)
+    return FALSE;
+
+  memset (stamp, 0, sizeof (*stamp));
+  stamp->dev = sb.st_dev;
+  stamp->ino = sb.st_ino;
+  stamp->size = sb.st_size;
+  stamp->mtime = sb.st_mtime;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+  stamp->mtime_nsec = sb.st_mtim.tv_nsec;
+#endif
+
+  return TRUE;
+}
+
+
+
+gboolean
+_xfce_rc_stamp_equal (const XfceRcStamp *a,
+                      const XfceRcStamp *b)
+{
+  return a->dev == b->dev
+         && a->ino == b->ino
+         && a->size == b->size
+         && a->mtime == b->mtime
+         && a->mtime_nsec == b->mtime_nsec;
+}
+
+
+
+GBytes *
+_xfce_rc_cache_lookup (const gchar *filename,
+                       const gchar *variant,
+                       gboolean shared,
+                       const XfceRcStamp *stamp,
+                       guint8 *digest)
+{
+  const CacheHeader *header;
+  GMappedFile *mapped_file;
+  const gchar *contents;
+  GBytes *bytes;
+  GBytes *payload;
+  gsize length;
+  gchar *path;
+  gint fd;
+
+  path = cache_get_path (filename, variant, shared, FALSE);
+  if (G_UNLIKELY (path == NULL))
+    return NULL;
+
+  fd = cache_open_image (path);
+  g_free (path);
+
+  if (fd < 0)
+    return NULL;
+
+  /* the mapping stays valid after the descriptor is closed */
+  mapped_file = g_mapped_file_new_from_fd (fd, FALSE, NULL);
+  close (fd);
+
+  if (mapped_file == NULL)
+    return NULL;
+
+  contents = g_mapped_file_get_contents (mapped_file);
+  length = g_mapped_file_get_length (mapped_file);
+  header = (const CacheHeader *) contents;
+
+  /* the payload is a sequence of nul-terminated strings, so if the
+   * image was truncated or overwritten, we do not use it at all */
+  if (length < sizeof (*header)
+      || header->magic != CACHE_MAGIC
+      || header->header_size != sizeof (*header)
+      || header->payload_len != length - sizeof (*header)
+      || (header->payload_len > 0 && contents[length - 1] != '\0')
+      || header->dev != stamp->dev
+      || header->ino != stamp->ino
+      || header->size != stamp->size
+      || header->mtime != stamp->mtime
+      || header->mtime_nsec != stamp->mtime_nsec)
+    {
+      g_mapped_file_unref (mapped_file);
+      return NULL;
+    }
+
+  memcpy (digest, header->digest, CACHE_DIGEST_LEN);
+
+  /* the payload keeps the mapping alive */
+  bytes = g_mapped_file_get_bytes (mapped_file);
+  payload = g_bytes_new_from_bytes (bytes, sizeof (*header), header->payload_len);
+  g_bytes_unref (bytes);
+  g_mapped_file_unref (mapped_file);
+
+  return payload;
+}
+
+
+
+void
+_xfce_rc_cache_store (const gchar *filename,
+                      const gchar *variant,
+                      gboolean shared,
+                      const XfceRcStamp *stamp,
+                      const guint8 *digest,
+                      const GString *payload)
+{
+  CacheHeader header;
+  GString *image;
+  GError *error = NULL;
+  gchar *path;
+  gint dir_fd;
+
+  path = cache_get_path (filename, variant, shared, TRUE);
+  if (G_UNLIKELY (path == NULL))
+    return;
+
+  /* never write into a directory that is not ours alone */
+  dir_fd = cache_open_dir (path);
+  if (dir_fd < 0)
+    {
+      g_free (path);
+      return;
+    }
+  close (dir_fd);
+
+  memset (&header, 0, sizeof (header));
+  header.magic = CACHE_MAGIC;
+  header.header_size = sizeof (header);
+  header.dev = stamp->dev;
+  header.ino = stamp->ino;
+  header.size = stamp->size;
+  header.mtime = stamp->mtime;
+  header.mtime_nsec = stamp->mtime_nsec;
+  header.payload_len = payload->len;
+  memcpy (header.digest, digest, CACHE_DIGEST_LEN);
+
+  image = g_string_sized_new (sizeof (header) + payload->len);
+  g_string_append_len (image, (const gchar *) &header, sizeof (header));
+  g_string_append_len (image, payload->str, payload->len);
+
+  /* other processes may map the old image, so always replace it */
+  if (!g_file_set_contents_full (path, image->str, image->len,
+                                 G_FILE_SET_CONTENTS_CONSISTENT, 0600, &error))
+    {
+      g_debug ("Unable to write rc cache %s for %s: %s", path, filename, error->message);
+      g_error_free (error);
+    }
+
+  g_string_free (image, TRUE);
+  g_free (path);
+}
+
+
+
+static gchar *
+memory_cache_key (const gchar *filename,
+                  const gchar *variant)
+{
+  return g_strconcat (variant, "\n", filename, NULL);
+}
+
+
+
+static void
+memory_image_free (MemoryImage *image)
+{
+  if (image->payload != NULL)
+    {
+      memory_cache_size -= g_bytes_get_size (image->payload);
+      g_bytes_unref (image->payload);
+    }
+  g_free (image->key);
+  g_slice_free (MemoryImage, image);
+}
+
+
+
+static void
+memory_cache_remove (MemoryImage *image)
+{
+  g_queue_remove (&memory_cache_order, image);
+  g_hash_table_remove (memory_cache, image->key);
+}
+
+
+
+static void
+memory_cache_insert (MemoryImage *image)
+{
+  if (G_UNLIKELY (memory_cache == NULL))
+    {
+      memory_cache = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                                            (GDestroyNotify) memory_image_free);
+    }
+
+  /* another thread may have stored the same file meanwhile */
+  if (g_hash_table_contains (memory_cache, image->key))
+    memory_cache_remove (g_hash_table_lookup (memory_cache, image->key));
+
+  g_hash_table_insert (memory_cache, image->key, image);
+  g_queue_push_tail (&memory_cache_order, image);
+  if (image->payload != NULL)
+    memory_cache_size += g_bytes_get_size (image->payload);
+
+  while (memory_cache_order.length > MEMORY_CACHE_MAX_IMAGES
+         || memory_cache_size > MEMORY_CACHE_MAX_SIZE)
+    memory_cache_remove (g_queue_peek_head (&memory_cache_order));
+}
+
+
+
+/* @seen is set if the caller should store the image: if the same,
+ * unchanged file was opened before, else the open is noted */
+GBytes *
+_xfce_rc_memory_cache_lookup (const gchar *filename,
+                              const gchar *variant,
+                              const XfceRcStamp *stamp,
+                              gboolean *seen)
+{
+  MemoryImage *image;
+  GBytes *payload = NULL;
+  gchar *key;
+
+  key = memory_cache_key (filename, variant);
+  *seen = FALSE;
+
+  G_LOCK (memory_cache);
+
+  image = (memory_cache != NULL) ? g_hash_table_lookup (memory_cache, key) : NULL;
+  if (image != NULL && _xfce_rc_stamp_equal (&image->stamp, stamp))
+    {
+      if (image->payload != NULL)
+        payload = g_bytes_ref (image->payload);
+      else
+        *seen = TRUE;
+      g_free (key);
+    }
+  else
+    {
+      /* replaces a stale image as well */
+      image = g_slice_new (MemoryImage);
+      image->key = key;
+      image->stamp = *stamp;
+      image->payload = NULL;
+      memory_cache_insert (image);
+    }
+
+  G_UNLOCK (memory_cache);
+
+  return payload;
+}
+
+
+
+void
+_xfce_rc_memory_cache_store (const gchar *filename,
+                             const gchar *variant,
+                             const XfceRcStamp *stamp,
+                             GBytes *payload)
+{
+  MemoryImage *image;
+  gsize size;
+
+  size = g_bytes_get_size (payload);
+  if (size > MEMORY_CACHE_MAX_SIZE / 4)
+    return;
+
+  image = g_slice_new (MemoryImage);
+  image->key = memory_cache_key (filename, variant);
+  image->stamp = *stamp;
+  image->payload = g_bytes_ref (payload);
+
+  G_LOCK (memory_cache);
+  memory_cache_insert (image);
+  G_UNLOCK (memory_cache);
+}
+
+
+
+#define __XFCE_RC_CACHE_C__
+#include "libxfce4util-visibility.c"
@@ -37,73 +37,255 @@
 
 
 
-static gchar **
-merge_arrays (gchar **source1,
-              gchar **source2);
-
-
-
 struct _XfceRcConfig
 {
   XfceRc __parent__;
   XfceRc *save;
   GSList *rclist;
+
+  /* group name -> GHashTable of key -> the layer whose entry wins,
+   * built when a group is first looked up, see config_get_index() */
+  GHashTable *index;
+  GStringChunk *index_strings;
+
+  /* the index of the current group, NULL if not looked up yet or if
+   * the layers are in different groups, like they are after opening */
+  GHashTable *current;
 };
 
 
 
-static gchar **
-merge_arrays (gchar **source1,
-              gchar **source2)
+/* adds the strings of @source that are not in @seen yet to @result, in
+ * order, and frees the others along with @source */
+static void
+merge_array (GPtrArray *result,
+             GHashTable *seen,
+             gchar **source)
 {
-  gchar **result;
-  gchar **rp;
   gchar **sp;
-  guint size;
-  guint pos;
-
-  result = g_new (gchar *, 11);
-  size = 10;
-  pos = 0;
 
-  for (sp = source1; *sp != NULL; ++sp)
+  for (sp = source; *sp != NULL; ++sp)
     {
-      if (pos == size)
+      if (g_hash_table_contains (seen, *sp))
         {
-          size *= 2;
-          result = g_realloc (result, (size + 1) * sizeof (*result));
+          g_free (*sp);
+          continue;
         }
-      result[pos] = *sp;
-      ++pos;
+
+      g_hash_table_add (seen, *sp);
+      g_ptr_array_add (result, *sp);
     }
 
-  for (sp = source2; *sp != NULL; ++sp)
+  g_free (source);
+}
+
+
+
+/* returns the union of the groups, or of the entries of the group @name,
+ * of all layers, the more important layers first */
+static gchar **
+config_merge_layers (const XfceRcConfig *config,
+                     gboolean entries,
+                     const gchar *name)
+{
+  GPtrArray *result = NULL;
+  GHashTable *seen = NULL;
+  gchar **first = NULL;
+  gchar **tmp;
+  GSList *list;
+
+  for (list = config->rclist; list != NULL; list = list->next)
     {
-      for (rp = result; rp < result + pos; ++rp)
-        if (strcmp (*rp, *sp) == 0)
-          break;
+      tmp = entries
+            ? _xfce_rc_simple_get_entries (XFCE_RC_CONST (list->data), name)
+            : _xfce_rc_simple_get_groups (XFCE_RC_CONST (list->data));
+      if (tmp == NULL)
+        continue;
 
-      if (rp == result + pos)
+      /* nothing to merge as long as only one layer has names */
+      if (first == NULL)
         {
-          g_free (*sp);
+          first = tmp;
           continue;
         }
 
-      if (pos == size)
+      if (result == NULL)
+        {
+          result = g_ptr_array_new ();
+          seen = g_hash_table_new (g_str_hash, g_str_equal);
+          merge_array (result, seen, first);
+        }
+
+      merge_array (result, seen, tmp);
+    }
+
+  if (result == NULL)
+    return first;
+
+  g_hash_table_destroy (seen);
+  g_ptr_array_add (result, NULL);
+
+  return (gchar **) g_ptr_array_free (result, FALSE);
+}
+
+
+
+/* drops the index, after the layers changed in ways that are not
+ * tracked entry by entry */
+static void
+config_clear_index (XfceRcConfig *config)
+{
+  if (config->index == NULL)
+    return;
+
+  g_hash_table_remove_all (config->index);
+  g_string_chunk_clear (config->index_strings);
+  config->current = NULL;
+}
+
+
+
+/* returns the index of the group @name, or NULL if no layer has it */
+static GHashTable *
+config_get_index (XfceRcConfig *config,
+                  const gchar *name)
+{
+  gconstpointer node;
+  GHashTable *index;
+  const gchar *key;
+  GSList *layers;
+  GSList *list;
+
+  if (G_UNLIKELY (config->index == NULL))
+    {
+      config->index = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                                             (GDestroyNotify) g_hash_table_destroy);
+      config->index_strings = g_string_chunk_new (256);
+    }
+
+  index = g_hash_table_lookup (config->index, name != NULL ? name : NULL_GROUP);
+  if (index != NULL)
+    return index;
+
+  if (!_xfce_rc_config_has_group (XFCE_RC_CONST (config), name))
+    return NULL;
+
+  /* the keys belong to the layers, the index is dropped before they go */
+  index = g_hash_table_new (g_str_hash, g_str_equal);
+  g_hash_table_insert (config->index,
+                       g_string_chunk_insert_const (config->index_strings,
+                                                    name != NULL ? name : NULL_GROUP),
+                       index);
+
+  /* the least important layer first, so the more important ones win */
+  layers = g_slist_reverse (g_slist_copy (config->rclist));
+  for (list = layers; list != NULL; list = list->next)
+    {
+      node = _xfce_rc_simple_iter_first (XFCE_RC_CONST (list->data), TRUE, name);
+      while (node != NULL)
         {
-          size += 2;
-          result = g_realloc (result, (size + 1) * sizeof (*result));
+          node = _xfce_rc_simple_iter_step (node, TRUE, &key);
+          g_hash_table_insert (index, (gpointer) key, list->data);
         }
-      result[pos] = *sp;
-      ++pos;
+    }
+  g_slist_free (layers);
+
+  return index;
+}
+
+
+
+/* returns the index of the current group of the user file if it was built already */
+static GHashTable *
+config_peek_current (XfceRcConfig *config)
+{
+  const gchar *name;
+
+  if (config->current != NULL)
+    return config->current;
+
+  if (config->index == NULL)
+    return NULL;
+
+  name = _xfce_rc_simple_get_group (config->save);
+
+  return g_hash_table_lookup (config->index, name != NULL ? name : NULL_GROUP);
+}
+
+
+
+/* whether all layers are in the same group, as after xfce_rc_set_group() */
+static gboolean
+config_layers_aligned (const XfceRcConfig *config)
+{
+  const gchar *name;
+  GSList *list;
+
+  name = _xfce_rc_simple_get_group (config->save);
+  for (list = config->rclist; list != NULL; list = list->next)
+    if (g_strcmp0 (_xfce_rc_simple_get_group (XFCE_RC_CONST (list->data)), name) != 0)
+      return FALSE;
+
+  return TRUE;
+}
+
+
+
+/* returns the layer whose entry @key in the group @name wins, so reads
+ * cost the same however many system files there are */
+static XfceRc *
+config_lookup_layer (const XfceRc *rc,
+                     const gchar *name,
+                     const gchar *key)
+{
+  XfceRcConfig *config = XFCE_RC_CONFIG (rc);
+  GHashTable *index;
+
+  XFCE_RC_STATS_ADD (rc, lookup_steps, 1);
+
+  /* without system files, the user file is all there is */
+  if (config->rclist->next == NULL)
+    return _xfce_rc_simple_has_group_entry (config->save, name, key) ? config->save : NULL;
+
+  index = config_get_index (config, name);
+  if (index == NULL)
+    return NULL;
+
+  return g_hash_table_lookup (index, key);
+}
+
+
+
+/* like config_lookup_layer(), for the current group */
+static XfceRc *
+config_lookup_current_layer (const XfceRc *rc,
+                             const gchar *key)
+{
+  XfceRcConfig *config = XFCE_RC_CONFIG (rc);
+  GSList *list;
+
+  if (config->current == NULL && config->rclist->next != NULL)
+    {
+      /* xfce_rc_set_group() adds the group to all layers, so it exists */
+      if (config_layers_aligned (config))
+        config->current = config_get_index (config, _xfce_rc_simple_get_group (config->save));
     }
 
-  result[pos] = NULL;
+  if (config->current != NULL)
+    {
+      XFCE_RC_STATS_ADD (rc, lookup_steps, 1);
+      return g_hash_table_lookup (config->current, key);
+    }
 
-  g_free (source1);
-  g_free (source2);
+  /* every layer looks at its own current group */
+  for (list = config->rclist; list != NULL; list = list->next)
+    {
+      XFCE_RC_STATS_ADD (rc, lookup_steps, 1);
+      if (_xfce_rc_simple_has_entry (XFCE_RC_CONST (list->data), key))
+        return list->data;
+    }
 
-  return result;
+  return NULL;
 }
 
 
@@ -130,6 +312,7 @@ _xfce_rc_config_new (XfceResourceType type,
   g_assert (paths != NULL);
 
   config = g_new0 (XfceRcConfig, 1);
+  _xfce_rc_stats_init (XFCE_RC (config));
 
   /* system files first */
   for (p = paths; *p != NULL; ++p)
@@ -141,6 +324,7 @@ _xfce_rc_config_new (XfceResourceType type,
         }
 
       simple = _xfce_rc_simple_new (simple, *p, TRUE);
+      _xfce_rc_simple_set_shared_image (simple);
       if (!_xfce_rc_simple_parse (simple))
         {
           g_critical ("Failed to parse file %s, ignoring.", *p);
@@ -171,14 +355,24 @@ _xfce_rc_config_new (XfceResourceType type,
   config->__parent__.delete_entry = _xfce_rc_config_delete_entry;
   config->__parent__.has_entry = _xfce_rc_config_has_entry;
   config->__parent__.read_entry = _xfce_rc_config_read_entry;
+  config->__parent__.lookup = _xfce_rc_config_lookup;
+  config->__parent__.get_layers = _xfce_rc_config_get_layers;
+  config->__parent__.layer_replaced = _xfce_rc_config_layer_replaced;
+  config->__parent__.iter_init = _xfce_rc_config_iter_init;
+  config->__parent__.compact = _xfce_rc_config_compact;
+  config->__parent__.iter_next = _xfce_rc_config_iter_next;
 
   if (!readonly)
     {
       config->__parent__.flush = _xfce_rc_config_flush;
       config->__parent__.rollback = _xfce_rc_config_rollback;
+      config->__parent__.begin = _xfce_rc_config_begin;
+      config->__parent__.commit = _xfce_rc_config_commit;
       config->__parent__.is_dirty = _xfce_rc_config_is_dirty;
       config->__parent__.is_readonly = _xfce_rc_config_is_readonly;
       config->__parent__.write_entry = _xfce_rc_config_write_entry;
+      config->__parent__.save_job = _xfce_rc_config_save_job;
+      config->__parent__.save_failed = _xfce_rc_config_save_failed;
     }
 
   g_strfreev (paths);
@@ -194,20 +388,25 @@ _xfce_rc_config_close (XfceRc *rc)
 {
   XfceRcConfig *config = XFCE_RC_CONFIG (rc);
 
+  if (config->index != NULL)
+    {
+      g_hash_table_destroy (config->index);
+      g_string_chunk_free (config->index_strings);
+    }
+
   g_slist_foreach (config->rclist, (GFunc) (void (*) (void)) xfce_rc_close, NULL);
   g_slist_free (config->rclist);
 }
 
 
 
-void
-_xfce_rc_config_flush (XfceRc *rc)
+/* create the base directory for the local rc file on demand */
+static void
+config_prepare_save (XfceRcConfig *config)
 {
-  XfceRcConfig *config = XFCE_RC_CONFIG (rc);
   const gchar *filename;
   gchar *dir;
 
-  /* create the base directory for the local rc file on demand */
   if (!_xfce_rc_simple_is_readonly (XFCE_RC_CONST (config->save)))
     {
       filename = _xfce_rc_simple_get_filename (XFCE_RC_CONST (config->save));
@@ -221,17 +420,81 @@ _xfce_rc_config_flush (XfceRc *rc)
       g_free (dir);
     }
 
+  XFCE_RC (config->save)->sync_mode = XFCE_RC (config)->sync_mode;
+}
+
+
+
+void
+_xfce_rc_config_flush (XfceRc *rc)
+{
+  XfceRcConfig *config = XFCE_RC_CONFIG (rc);
+
+  config_prepare_save (config);
   _xfce_rc_simple_flush (XFCE_RC (config->save));
 }
 
 
 
+XfceRcSaveJob *
+_xfce_rc_config_save_job (XfceRc *rc)
+{
+  XfceRcConfig *config = XFCE_RC_CONFIG (rc);
+
+  if (!_xfce_rc_simple_is_dirty (XFCE_RC_CONST (config->save)))
+    return NULL;
+
+  config_prepare_save (config);
+
+  return _xfce_rc_simple_save_job (XFCE_RC (config->save));
+}
+
+
+
+void
+_xfce_rc_config_save_failed (XfceRc *rc,
+                             guint serial)
+{
+  XfceRcConfig *config = XFCE_RC_CONFIG (rc);
+
+  _xfce_rc_simple_save_failed (XFCE_RC (config->save), serial);
+}
+
+
+
+/* xfce_rc_set_group() adds groups to all layers, so the
+ * transaction spans all of them */
+void
+_xfce_rc_config_begin (XfceRc *rc)
+{
+  XfceRcConfig *config = XFCE_RC_CONFIG (rc);
+
+  g_slist_foreach (config->rclist, (GFunc) (void (*) (void)) _xfce_rc_simple_begin, NULL);
+}
+
+
+
+void
+_xfce_rc_config_commit (XfceRc *rc)
+{
+  XfceRcConfig *config = XFCE_RC_CONFIG (rc);
+
+  g_slist_foreach (config->rclist, (GFunc) (void (*) (void)) _xfce_rc_simple_commit, NULL);
+}
+
+
+
 void
 _xfce_rc_config_rollback (XfceRc *rc)
 {
   XfceRcConfig *config = XFCE_RC_CONFIG (rc);
 
-  _xfce_rc_simple_rollback (XFCE_RC (config->save));
+  if (_xfce_rc_simple_in_transaction (XFCE_RC_CONST (config->save)))
+    g_slist_foreach (config->rclist, (GFunc) (void (*) (void)) _xfce_rc_simple_rollback, NULL);
+  else
+    _xfce_rc_simple_rollback (XFCE_RC (config->save));
+
+  config_clear_index (config);
 }
 
 
@@ -259,24 +522,7 @@ _xfce_rc_config_is_readonly (const XfceRc *rc)
 gchar **
 _xfce_rc_config_get_groups (const XfceRc *rc)
 {
-  const XfceRcConfig *config = XFCE_RC_CONFIG_CONST (rc);
-  gchar **result = NULL;
-  gchar **tmp;
-  GSList *list;
-
-  for (list = config->rclist; list != NULL; list = list->next)
-    {
-      tmp = _xfce_rc_simple_get_groups (XFCE_RC_CONST (list->data));
-      if (tmp == NULL)
-        continue;
-
-      if (result == NULL)
-        result = tmp;
-      else
-        result = merge_arrays (result, tmp);
-    }
-
-  return result;
+  return config_merge_layers (XFCE_RC_CONFIG_CONST (rc), FALSE, NULL);
 }
 
 
@@ -284,24 +530,7 @@ gchar **
 _xfce_rc_config_get_entries (const XfceRc *rc,
                              const gchar *name)
 {
-  const XfceRcConfig *config = XFCE_RC_CONFIG_CONST (rc);
-  gchar **result = NULL;
-  gchar **tmp;
-  GSList *list;
-
-  for (list = config->rclist; list != NULL; list = list->next)
-    {
-      tmp = _xfce_rc_simple_get_entries (XFCE_RC_CONST (list->data), name);
-      if (tmp == NULL)
-        continue;
-
-      if (result == NULL)
-        result = tmp;
-      else
-        result = merge_arrays (result, tmp);
-    }
-
-  return result;
+  return config_merge_layers (XFCE_RC_CONFIG_CONST (rc), TRUE, name);
 }
 
 
@@ -314,6 +543,13 @@ _xfce_rc_config_delete_group (XfceRc *rc,
   XfceRcConfig *config = XFCE_RC_CONFIG (rc);
 
   _xfce_rc_simple_delete_group (XFCE_RC (config->save), name, global);
+
+  /* the entries of the other layers show through again */
+  if (config->index != NULL)
+    {
+      g_hash_table_remove (config->index, name != NULL ? name : NULL_GROUP);
+      config->current = NULL;
+    }
 }
 
 
@@ -354,6 +590,8 @@ _xfce_rc_config_set_group (XfceRc *rc,
 
   for (list = config->rclist; list != NULL; list = list->next)
     _xfce_rc_simple_set_group (XFCE_RC (list->data), name);
+
+  config->current = NULL;
 }
 
 
@@ -364,8 +602,26 @@ _xfce_rc_config_delete_entry (XfceRc *rc,
                               gboolean global)
 {
   XfceRcConfig *config = XFCE_RC_CONFIG (rc);
+  GHashTable *index;
+  const gchar *name;
+  GSList *list;
 
   _xfce_rc_simple_delete_entry (XFCE_RC (config->save), key, global);
+
+  index = config_peek_current (config);
+  if (index == NULL || g_hash_table_lookup (index, key) != config->save)
+    return;
+
+  /* the entry of the next layer that has one shows through again */
+  name = _xfce_rc_simple_get_group (config->save);
+  for (list = config->rclist->next; list != NULL; list = list->next)
+    if (_xfce_rc_simple_has_group_entry (XFCE_RC_CONST (list->data), name, key))
+      break;
+
+  if (list != NULL)
+    g_hash_table_insert (index, (gpointer) key, list->data);
+  else
+    g_hash_table_remove (index, key);
 }
 
 
@@ -374,15 +630,8 @@ gboolean
 _xfce_rc_config_has_entry (const XfceRc *rc,
                            const gchar *key)
 {
-  const XfceRcConfig *config = XFCE_RC_CONFIG_CONST (rc);
-  GSList *list;
-
   /* atleast one has to have the specified entry! */
-  for (list = config->rclist; list != NULL; list = list->next)
-    if (_xfce_rc_simple_has_entry (XFCE_RC_CONST (list->data), key))
-      return TRUE;
-
-  return FALSE;
+  return config_lookup_current_layer (rc, key) != NULL;
 }
 
 
@@ -391,21 +640,49 @@ const gchar *
 _xfce_rc_config_read_entry (const XfceRc *rc,
                             const gchar *key,
                             gboolean translated)
+{
+  XfceRc *layer;
+
+  layer = config_lookup_current_layer (rc, key);
+  if (layer == NULL)
+    return NULL;
+
+  return _xfce_rc_simple_read_entry (layer, key, translated);
+}
+
+
+
+const gchar *
+_xfce_rc_config_lookup (const XfceRc *rc,
+                        const gchar *group,
+                        const gchar *key,
+                        gboolean translated)
+{
+  XfceRc *layer;
+
+  layer = config_lookup_layer (rc, group, key);
+  if (layer == NULL)
+    return NULL;
+
+  return _xfce_rc_simple_lookup (layer, group, key, translated);
+}
+
+
+
+GSList *
+_xfce_rc_config_get_layers (XfceRc *rc)
 {
   XfceRcConfig *config = XFCE_RC_CONFIG (rc);
-  const gchar *value;
-  GSList *list;
 
-  for (list = config->rclist; list != NULL; list = list->next)
-    {
-      value = _xfce_rc_simple_read_entry (XFCE_RC_CONST (list->data),
-                                          key,
-                                          translated);
-      if (value != NULL)
-        return value;
-    }
+  return g_slist_copy (config->rclist);
+}
 
-  return NULL;
+
+
+void
+_xfce_rc_config_layer_replaced (XfceRc *rc)
+{
+  config_clear_index (XFCE_RC_CONFIG (rc));
 }
 
 
@@ -416,10 +693,111 @@ _xfce_rc_config_write_entry (XfceRc *rc,
                              const gchar *value)
 {
   XfceRcConfig *config = XFCE_RC_CONFIG (rc);
+  GHashTable *index;
 
   /* XXX - don't write default values */
-  if (!_xfce_rc_simple_is_readonly (XFCE_RC (config->save)))
-    _xfce_rc_simple_write_entry (XFCE_RC (config->save), key, value);
+  if (_xfce_rc_simple_is_readonly (XFCE_RC (config->save)))
+    return;
+
+  _xfce_rc_simple_write_entry (XFCE_RC (config->save), key, value);
+
+  /* the user file wins from now on */
+  index = config_peek_current (config);
+  if (index != NULL)
+    {
+      if (!g_hash_table_contains (index, key))
+        key = g_string_chunk_insert_const (config->index_strings, key);
+      g_hash_table_insert (index, (gpointer) key, config->save);
+    }
+}
+
+
+
+void
+_xfce_rc_config_iter_init (XfceRcRealIter *iter)
+{
+  const XfceRcConfig *config = XFCE_RC_CONFIG_CONST (iter->rc);
+
+  iter->layer = config->rclist;
+  iter->node = _xfce_rc_simple_iter_first (XFCE_RC_CONST (iter->layer->data),
+                                           iter->entries, iter->group);
+}
+
+
+
+gboolean
+_xfce_rc_config_iter_next (XfceRcRealIter *iter,
+                           const gchar **name)
+{
+  const XfceRcConfig *config = XFCE_RC_CONFIG_CONST (iter->rc);
+  GSList *list;
+
+  for (;;)
+    {
+      /* continue with the next layer */
+      while (iter->node == NULL)
+        {
+          if (iter->layer->next == NULL)
+            return FALSE;
+
+          iter->layer = iter->layer->next;
+          iter->node = _xfce_rc_simple_iter_first (XFCE_RC_CONST (iter->layer->data),
+                                                   iter->entries, iter->group);
+        }
+
+      iter->node = _xfce_rc_simple_iter_step (iter->node, iter->entries, name);
+
+      /* skip names that were already returned for a more specific layer */
+      for (list = config->rclist; list != iter->layer; list = list->next)
+        {
+          if (iter->entries
+                ? _xfce_rc_simple_has_group_entry (XFCE_RC_CONST (list->data), iter->group, *name)
+                : _xfce_rc_simple_has_group (XFCE_RC_CONST (list->data), *name))
+            break;
+        }
+
+      if (list == iter->layer)
+        return TRUE;
+    }
+}
+
+
+
+void
+_xfce_rc_config_compact (XfceRc *rc)
+{
+  XfceRcConfig *config = XFCE_RC_CONFIG (rc);
+  GStringChunk *old_chunk;
+  GStringChunk *chunk;
+  GSList *old_chunks = NULL;
+  GSList *list;
+
+  /* an open transaction still refers to the old strings */
+  if (_xfce_rc_simple_in_transaction (XFCE_RC_CONST (config->save)))
+    return;
+
+  /* the user file is changed by writes, all files by reloads */
+  for (list = config->rclist; list != NULL; list = list->next)
+    if (_xfce_rc_simple_get_garbage (XFCE_RC_CONST (list->data)) > 0)
+      break;
+
+  if (list == NULL)
+    return;
+
+  /* the layers share their strings, so all of them move to one new chunk,
+   * owned by the last layer, and all chunks owned by any layer are freed
+   * once no layer refers to them anymore */
+  chunk = g_string_chunk_new (4096);
+  for (list = config->rclist; list != NULL; list = list->next)
+    {
+      old_chunk = _xfce_rc_simple_move_strings (XFCE_RC (list->data), chunk, list->next == NULL);
+      if (old_chunk != NULL)
+        old_chunks = g_slist_prepend (old_chunks, old_chunk);
+    }
+  g_slist_free_full (old_chunks, (GDestroyNotify) g_string_chunk_free);
+
+  /* the index refers to the old strings */
+  config_clear_index (config);
 }
 
 
@@ -27,7 +27,11 @@
 G_BEGIN_DECLS
 
 typedef struct _XfceRcConfig XfceRcConfig;
+typedef struct _XfceRcRealIter XfceRcRealIter;
 typedef struct _XfceRcSimple XfceRcSimple;
+typedef struct _XfceRcSaveJob XfceRcSaveJob;
+typedef struct _XfceRcStamp XfceRcStamp;
+typedef struct _XfceRcWatch XfceRcWatch;
 
 struct _XfceRc
 {
@@ -35,6 +39,9 @@ struct _XfceRc
   void (*close) (XfceRc *rc);
   void (*flush) (XfceRc *rc);
   void (*rollback) (XfceRc *rc);
+  /* see xfce_rc_begin(), rollback undoes an open transaction */
+  void (*begin) (XfceRc *rc);
+  void (*commit) (XfceRc *rc);
   gboolean (*is_dirty) (const XfceRc *rc);
   gboolean (*is_readonly) (const XfceRc *rc);
   gchar **(*get_groups) (const XfceRc *rc);
@@ -60,14 +67,95 @@ struct _XfceRc
   void (*write_entry) (XfceRc *rc,
                        const gchar *key,
                        const gchar *value);
+  /* takes the dirty state, NULL if there is nothing to write */
+  XfceRcSaveJob *(*save_job) (XfceRc *rc);
+  /* gives it back if the job with @serial was the last one taken */
+  void (*save_failed) (XfceRc *rc,
+                       guint serial);
+  void (*compact) (XfceRc *rc);
+  /* read_entry without the current group, see XfceRcSnapshot */
+  const gchar *(*lookup) (const XfceRc *rc,
+                          const gchar *group,
+                          const gchar *key,
+                          gboolean translated);
+  /* the XfceRcSimple files @rc consists of, most important first */
+  GSList *(*get_layers) (XfceRc *rc);
+  /* called after a layer was parsed again, may be NULL */
+  void (*layer_replaced) (XfceRc *rc);
+  void (*iter_init) (XfceRcRealIter *iter);
+  gboolean (*iter_next) (XfceRcRealIter *iter,
+                         const gchar **name);
 
   gchar *locale;
   gchar **languages;
+
+  XfceRcSyncMode sync_mode;
+
+  /* see xfce_rc_set_auto_flush() */
+  guint auto_flush_interval;
+  GMainContext *auto_flush_context;
+  GSource *auto_flush_source;
+
+  /* the xfce_rc_flush_async() calls that did not finish yet */
+  GSList *pending_flushes;
+
+  /* the latest published snapshot, protected by a lock in xfce-rc.c */
+  XfceRcSnapshot *snapshot;
+
+  /* see xfce_rc_watch() */
+  XfceRcWatch *watch;
+
+  /* see xfce_rc_get_stats(), NULL unless enabled */
+  XfceRcStats *stats;
+};
+
+/* the serialized contents of a dirty rc, ready to be written */
+struct _XfceRcSaveJob
+{
+  gchar *filename;
+  GString *contents;
+  XfceRcSyncMode sync_mode;
+  guint serial;
+};
+
+/* the private layout of XfceRcIter */
+struct _XfceRcRealIter
+{
+  const XfceRc *rc;
+  /* the layer of an XfceRcConfig the node belongs to */
+  GSList *layer;
+  /* the next group or entry to return */
+  gconstpointer node;
+  /* the group whose entries are walked */
+  const gchar *group;
+  gint entries;
 };
 
+/* identifies one version of a file on disk */
+struct _XfceRcStamp
+{
+  guint64 dev;
+  guint64 ino;
+  guint64 size;
+  gint64 mtime;
+  gint64 mtime_nsec;
+};
+
+/* name of the NULL group */
+#define NULL_GROUP "[NULL]"
+
 #define XFCE_RC_CONFIG(obj) ((XfceRcConfig *) (obj))
 #define XFCE_RC_CONFIG_CONST(obj) ((const XfceRcConfig *) (obj))
 
+/* adds @n to a counter of @rc, if statistics are enabled */
+#define XFCE_RC_STATS_ADD(rc, counter, n) \
+  G_STMT_START \
+  { \
+    if (G_UNLIKELY (XFCE_RC_CONST (rc)->stats != NULL)) \
+      XFCE_RC_CONST (rc)->stats->counter += (n); \
+  } \
+  G_STMT_END
+
 #define XFCE_RC_SIMPLE(obj) ((XfceRcSimple *) (obj))
 #define XFCE_RC_SIMPLE_CONST(obj) ((const XfceRcSimple *) (obj))
 
@@ -79,34 +167,57 @@ G_GNUC_INTERNAL XfceRcSimple *
 _xfce_rc_simple_new (XfceRcSimple *shared,
                      const gchar *filename,
                      gboolean readonly);
+G_GNUC_INTERNAL void
+_xfce_rc_simple_set_projection (XfceRcSimple *simple,
+                                const gchar *const *groups,
+                                const gchar *const *keys);
+G_GNUC_INTERNAL void
+_xfce_rc_simple_set_shared_image (XfceRcSimple *simple);
 G_GNUC_INTERNAL gboolean
 _xfce_rc_simple_parse (XfceRcSimple *simple);
+G_GNUC_INTERNAL gboolean
+_xfce_rc_simple_parse_lazy (XfceRcSimple *simple);
+G_GNUC_INTERNAL void
+_xfce_rc_simple_parse_data (XfceRcSimple *simple,
+                            const gchar *data,
+                            gsize length);
+G_GNUC_INTERNAL gboolean
+_xfce_rc_simple_parse_events (const gchar *start,
+                              const gchar *end,
+                              const XfceRcParser *parser,
+                              gpointer user_data);
 G_GNUC_INTERNAL void
 _xfce_rc_simple_close (XfceRc *rc);
 G_GNUC_INTERNAL void
 _xfce_rc_simple_flush (XfceRc *rc);
 G_GNUC_INTERNAL void
+_xfce_rc_simple_begin (XfceRc *rc);
+G_GNUC_INTERNAL void
+_xfce_rc_simple_commit (XfceRc *rc);
+G_GNUC_INTERNAL void
 _xfce_rc_simple_rollback (XfceRc *rc);
 G_GNUC_INTERNAL gboolean
-_xfce_rc_simple_is_dirty (const XfceRc *rc) G_GNUC_CONST;
+_xfce_rc_simple_in_transaction (const XfceRc *rc);
 G_GNUC_INTERNAL gboolean
-_xfce_rc_simple_is_readonly (const XfceRc *rc) G_GNUC_CONST;
+_xfce_rc_simple_is_dirty (const XfceRc *rc);
+G_GNUC_INTERNAL gboolean
+_xfce_rc_simple_is_readonly (const XfceRc *rc);
 G_GNUC_INTERNAL const gchar *
-_xfce_rc_simple_get_filename (const XfceRc *rc) G_GNUC_CONST;
+_xfce_rc_simple_get_filename (const XfceRc *rc);
 G_GNUC_INTERNAL gchar **
-_xfce_rc_simple_get_groups (const XfceRc *rc) G_GNUC_CONST;
+_xfce_rc_simple_get_groups (const XfceRc *rc);
 G_GNUC_INTERNAL gchar **
 _xfce_rc_simple_get_entries (const XfceRc *rc,
-                             const gchar *name) G_GNUC_CONST;
+                             const gchar *name);
 G_GNUC_INTERNAL void
 _xfce_rc_simple_delete_group (XfceRc *rc,
                               const gchar *name,
                               gboolean global);
 G_GNUC_INTERNAL const gchar *
-_xfce_rc_simple_get_group (const XfceRc *rc) G_GNUC_CONST;
+_xfce_rc_simple_get_group (const XfceRc *rc);
 G_GNUC_INTERNAL gboolean
 _xfce_rc_simple_has_group (const XfceRc *rc,
-                           const gchar *name) G_GNUC_CONST;
+                           const gchar *name);
 G_GNUC_INTERNAL void
 _xfce_rc_simple_set_group (XfceRc *rc,
                            const gchar *name);
@@ -116,15 +227,102 @@ _xfce_rc_simple_delete_entry (XfceRc *rc,
                               gboolean global);
 G_GNUC_INTERNAL gboolean
 _xfce_rc_simple_has_entry (const XfceRc *rc,
-                           const gchar *key) G_GNUC_CONST;
+                           const gchar *key);
 G_GNUC_INTERNAL const gchar *
 _xfce_rc_simple_read_entry (const XfceRc *rc,
                             const gchar *key,
-                            gboolean translated) G_GNUC_CONST;
+                            gboolean translated);
 G_GNUC_INTERNAL void
 _xfce_rc_simple_write_entry (XfceRc *rc,
                              const gchar *key,
                              const gchar *value);
+G_GNUC_INTERNAL XfceRcSaveJob *
+_xfce_rc_simple_save_job (XfceRc *rc);
+G_GNUC_INTERNAL void
+_xfce_rc_simple_save_failed (XfceRc *rc,
+                             guint serial);
+G_GNUC_INTERNAL gboolean
+_xfce_rc_simple_is_saved (const XfceRc *rc);
+G_GNUC_INTERNAL const gchar *
+_xfce_rc_simple_lookup (const XfceRc *rc,
+                        const gchar *name,
+                        const gchar *key,
+                        gboolean translated);
+G_GNUC_INTERNAL gsize
+_xfce_rc_simple_get_garbage (const XfceRc *rc);
+G_GNUC_INTERNAL GStringChunk *
+_xfce_rc_simple_move_strings (XfceRc *rc,
+                              GStringChunk *chunk,
+                              gboolean owner);
+G_GNUC_INTERNAL void
+_xfce_rc_simple_compact (XfceRc *rc);
+G_GNUC_INTERNAL GSList *
+_xfce_rc_simple_get_layers (XfceRc *rc);
+G_GNUC_INTERNAL XfceRc *
+_xfce_rc_simple_reparse (XfceRc *rc);
+G_GNUC_INTERNAL void
+_xfce_rc_simple_diff (XfceRc *rc,
+                      XfceRc *fresh,
+                      GPtrArray *changed);
+G_GNUC_INTERNAL void
+_xfce_rc_simple_replace (XfceRc *rc,
+                         XfceRc *fresh);
+G_GNUC_INTERNAL gboolean
+_xfce_rc_simple_has_group_entry (const XfceRc *rc,
+                                 const gchar *name,
+                                 const gchar *key);
+G_GNUC_INTERNAL gconstpointer
+_xfce_rc_simple_iter_first (const XfceRc *rc,
+                            gboolean entries,
+                            const gchar *name);
+G_GNUC_INTERNAL gconstpointer
+_xfce_rc_simple_iter_step (gconstpointer node,
+                           gboolean entries,
+                           const gchar **name);
+G_GNUC_INTERNAL void
+_xfce_rc_simple_iter_init (XfceRcRealIter *iter);
+G_GNUC_INTERNAL gboolean
+_xfce_rc_simple_iter_next (XfceRcRealIter *iter,
+                           const gchar **name);
+
+G_GNUC_INTERNAL gboolean
+_xfce_rc_save_job_run (const XfceRcSaveJob *job,
+                       gboolean *written,
+                       GError **error);
+G_GNUC_INTERNAL void
+_xfce_rc_save_job_free (XfceRcSaveJob *job);
+
+G_GNUC_INTERNAL gboolean
+_xfce_rc_cache_enabled (void);
+G_GNUC_INTERNAL gboolean
+_xfce_rc_stamp_init (XfceRcStamp *stamp,
+                     const gchar *filename);
+G_GNUC_INTERNAL gboolean
+_xfce_rc_stamp_equal (const XfceRcStamp *a,
+                      const XfceRcStamp *b);
+G_GNUC_INTERNAL GBytes *
+_xfce_rc_cache_lookup (const gchar *filename,
+                       const gchar *variant,
+                       gboolean shared,
+                       const XfceRcStamp *stamp,
+                       guint8 *digest);
+G_GNUC_INTERNAL void
+_xfce_rc_cache_store (const gchar *filename,
+                      const gchar *variant,
+                      gboolean shared,
+                      const XfceRcStamp *stamp,
+                      const guint8 *digest,
+                      const GString *payload);
+G_GNUC_INTERNAL GBytes *
+_xfce_rc_memory_cache_lookup (const gchar *filename,
+                              const gchar *variant,
+                              const XfceRcStamp *stamp,
+                              gboolean *seen);
+G_GNUC_INTERNAL void
+_xfce_rc_memory_cache_store (const gchar *filename,
+                             const gchar *variant,
+                             const XfceRcStamp *stamp,
+                             GBytes *payload);
 
 G_GNUC_INTERNAL XfceRcConfig *
 _xfce_rc_config_new (XfceResourceType type,
@@ -135,25 +333,29 @@ _xfce_rc_config_close (XfceRc *rc);
 G_GNUC_INTERNAL void
 _xfce_rc_config_flush (XfceRc *rc);
 G_GNUC_INTERNAL void
+_xfce_rc_config_begin (XfceRc *rc);
+G_GNUC_INTERNAL void
+_xfce_rc_config_commit (XfceRc *rc);
+G_GNUC_INTERNAL void
 _xfce_rc_config_rollback (XfceRc *rc);
 G_GNUC_INTERNAL gboolean
-_xfce_rc_config_is_dirty (const XfceRc *rc) G_GNUC_CONST;
+_xfce_rc_config_is_dirty (const XfceRc *rc);
 G_GNUC_INTERNAL gboolean
-_xfce_rc_config_is_readonly (const XfceRc *rc) G_GNUC_CONST;
+_xfce_rc_config_is_readonly (const XfceRc *rc);
 G_GNUC_INTERNAL gchar **
-_xfce_rc_config_get_groups (const XfceRc *rc) G_GNUC_CONST;
+_xfce_rc_config_get_groups (const XfceRc *rc);
 G_GNUC_INTERNAL gchar **
 _xfce_rc_config_get_entries (const XfceRc *rc,
-                             const gchar *name) G_GNUC_CONST;
+                             const gchar *name);
 G_GNUC_INTERNAL void
 _xfce_rc_config_delete_group (XfceRc *rc,
                               const gchar *name,
                               gboolean global);
 G_GNUC_INTERNAL const gchar *
-_xfce_rc_config_get_group (const XfceRc *rc) G_GNUC_CONST;
+_xfce_rc_config_get_group (const XfceRc *rc);
 G_GNUC_INTERNAL gboolean
 _xfce_rc_config_has_group (const XfceRc *rc,
-                           const gchar *name) G_GNUC_CONST;
+                           const gchar *name);
 G_GNUC_INTERNAL void
 _xfce_rc_config_set_group (XfceRc *rc,
                            const gchar *name);
@@ -163,15 +365,48 @@ _xfce_rc_config_delete_entry (XfceRc *rc,
                               gboolean global);
 G_GNUC_INTERNAL gboolean
 _xfce_rc_config_has_entry (const XfceRc *rc,
-                           const gchar *key) G_GNUC_CONST;
+                           const gchar *key);
 G_GNUC_INTERNAL const gchar *
 _xfce_rc_config_read_entry (const XfceRc *rc,
                             const gchar *key,
-                            gboolean translated) G_GNUC_CONST;
+                            gboolean translated);
 G_GNUC_INTERNAL void
 _xfce_rc_config_write_entry (XfceRc *rc,
                              const gchar *key,
                              const gchar *value);
+G_GNUC_INTERNAL XfceRcSaveJob *
+_xfce_rc_config_save_job (XfceRc *rc);
+G_GNUC_INTERNAL void
+_xfce_rc_config_save_failed (XfceRc *rc,
+                             guint serial);
+G_GNUC_INTERNAL const gchar *
+_xfce_rc_config_lookup (const XfceRc *rc,
+                        const gchar *group,
+                        const gchar *key,
+                        gboolean translated);
+G_GNUC_INTERNAL GSList *
+_xfce_rc_config_get_layers (XfceRc *rc);
+G_GNUC_INTERNAL void
+_xfce_rc_config_layer_replaced (XfceRc *rc);
+G_GNUC_INTERNAL void
+_xfce_rc_config_compact (XfceRc *rc);
+G_GNUC_INTERNAL void
+_xfce_rc_config_iter_init (XfceRcRealIter *iter);
+G_GNUC_INTERNAL gboolean
+_xfce_rc_config_iter_next (XfceRcRealIter *iter,
+                           const gchar **name);
+
+G_GNUC_INTERNAL XfceRcSnapshot *
+_xfce_rc_snapshot_new (XfceRc *rc);
+
+G_GNUC_INTERNAL gboolean
+_xfce_rc_stats_enabled (void);
+G_GNUC_INTERNAL void
+_xfce_rc_stats_init (XfceRc *rc);
+G_GNUC_INTERNAL void
+_xfce_rc_stats_publish (XfceRc *rc);
+G_GNUC_INTERNAL void
+_xfce_rc_stats_free (XfceRc *rc);
 
 G_END_DECLS
 
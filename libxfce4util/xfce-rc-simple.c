@@ -19,6 +19,11 @@
  * Boston, MA 02110-1301 USA
  */
 
+/* for O_TMPFILE */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
@@ -26,10 +31,12 @@
 #ifdef HAVE_ERRNO_H
 #include <errno.h>
 #endif
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
 #ifdef HAVE_MEMORY_H
 #include <memory.h>
 #endif
-#include <stdio.h>
 #ifdef HAVE_STRING_H
 #include <string.h>
 #endif
@@ -42,44 +49,103 @@
 #include "libxfce4util-visibility.h"
 
 
-#ifndef PATH_MAX
-#define PATH_MAX 4096
-#endif
+/* size of the blocks nodes are carved from */
+#define ARENA_BLOCK_SIZE 4096
 
-/* name of the NULL group */
-#define NULL_GROUP "[NULL]"
+/* allocates and frees nodes of @simple, like g_slice_new and g_slice_free */
+#define arena_new(simple, type) ((type *) simple_arena_alloc ((simple), sizeof (type)))
+#define arena_free(simple, type, node) simple_arena_free ((simple), (node), sizeof (type))
+
+/* the size of the digests in SavedFile */
+#define DIGEST_LEN 32
+
+/* filename -> SavedFile of the files that are open for writing or have
+ * save jobs, the lock protects the table and all fields of its values
+ * but the write locks */
+G_LOCK_DEFINE_STATIC (saved_files);
+static GHashTable *saved_files = NULL;
+static gint save_serial = 1;
 
 
 typedef struct _Entry Entry;
 typedef struct _LEntry LEntry;
 typedef struct _Group Group;
+typedef struct _SavedFile SavedFile;
+typedef struct _Span Span;
+typedef struct _Token Token;
+typedef struct _Undo Undo;
+
+typedef enum
+{
+  UNDO_GROUP_ADDED,
+  UNDO_GROUP_UNLINKED,
+  UNDO_GROUP_CLEARED,
+  UNDO_ENTRY_ADDED,
+  UNDO_ENTRY_UNLINKED,
+  UNDO_VALUE_CHANGED,
+} UndoOp;
 
 
 
+static Group *
+simple_new_group (XfceRcSimple *simple,
+                  gchar *name);
 static Group *
 simple_add_group (XfceRcSimple *simple,
                   const gchar *name);
 static Entry *
+simple_new_entry (XfceRcSimple *simple,
+                  gchar *key,
+                  gchar *value);
+static Entry *
 simple_add_entry (XfceRcSimple *simple,
                   const gchar *key,
                   const gchar *value,
+                  gssize value_len,
                   const gchar *locale);
 static gboolean
-simple_parse_line (gchar *line,
-                   gchar **section,
-                   gchar **key,
-                   gchar **value,
-                   gchar **locale);
+simple_parse_line (const gchar *line,
+                   const gchar *end,
+                   Token *section,
+                   Token *key,
+                   Token *value,
+                   Token *locale);
 static void
-simple_write_escaped (const gchar *string,
-                      FILE *fp);
+simple_unescape (const gchar *string,
+                 gsize len,
+                 GString *buffer);
+static void
+simple_write_escaped (GString *buffer,
+                      const gchar *string);
 static gboolean
-simple_write (XfceRcSimple *simple,
-              const gchar *filename);
+simple_write (const gchar *filename,
+              const GString *contents,
+              XfceRcSyncMode sync_mode,
+              GError **error);
+static void
+simple_entry_free (XfceRcSimple *simple,
+                   Entry *entry);
 static void
-simple_entry_free (Entry *entry);
+simple_group_free (XfceRcSimple *simple,
+                   Group *group);
 static void
-simple_group_free (Group *group);
+simple_write_image (XfceRcSimple *simple,
+                    GString *payload);
+static void
+simple_read_image (XfceRcSimple *simple,
+                   const gchar *payload,
+                   gsize payload_len);
+static void
+simple_load_group (XfceRcSimple *simple,
+                   Group *group);
+static void
+simple_load_all (XfceRcSimple *simple);
+static const gchar *
+simple_entry_value (const XfceRc *rc,
+                    Entry *entry,
+                    gboolean translated);
+static SavedFile *
+simple_ref_saved_file (const gchar *filename);
 
 
 
@@ -91,13 +157,55 @@ struct _XfceRcSimple
 
   gchar *filename;
 
+  /* groups in file order, plus a name index for lookups */
   Group *gfirst;
   Group *glast;
   Group *group;
+  GHashTable *groups;
+
+  /* compiled image the strings point into, if loaded from a cache */
+  GBytes *image;
+
+  /* contents of the file of a lazy handle, as long as groups are left
+   * to parse; a copy, so the file may change under us without harm */
+  GBytes *source;
+  guint n_pending;
+
+  /* all nodes live in these blocks, freed nodes are kept for reuse
+   * in a list per size (in pointers) */
+  GPtrArray *arena;
+  gchar *arena_pos;
+  gsize arena_left;
+  gpointer arena_free[9];
+
+  /* bytes in the string chunk that are no longer referenced */
+  gsize garbage;
+
+  /* the only groups and keys the parser keeps, if not NULL */
+  GHashTable *keep_groups;
+  GHashTable *keep_keys;
+
+  /* the changes since xfce_rc_begin(), NULL outside of a transaction,
+   * plus the current group and dirty flag to return to */
+  GArray *undo;
+  Group *undo_group;
+  guint undo_dirty : 1;
+
+  /* what we know about the file, NULL if it is read-only */
+  SavedFile *saved;
+
+  /* the serial of the last save job taken from the handle */
+  guint last_serial;
 
   guint shared_chunks : 1;
   guint dirty : 1;
   guint readonly : 1;
+
+  /* the image of the file is shared with other processes */
+  guint shared_image : 1;
+
+  /* the parser is in a group that is not kept */
+  guint skip_group : 1;
 };
 
 struct _Entry
@@ -108,6 +216,10 @@ struct _Entry
   Entry *prev;
   LEntry *lfirst;
   LEntry *llast;
+
+  /* the translation read_entry returns, once looked up */
+  LEntry *lbest;
+  guint lresolved : 1;
 };
 
 struct _LEntry
@@ -125,6 +237,66 @@ struct _Group
   Group *prev;
   Entry *efirst;
   Entry *elast;
+  GHashTable *entries;
+
+  /* parts of the source file that were not parsed yet */
+  Span *pending;
+};
+
+/* the body of a group in the source of a lazy handle, without its header */
+struct _Span
+{
+  const gchar *start;
+  const gchar *end;
+  Span *next;
+};
+
+/* the arena keeps free lists for nodes of up to 8 pointers */
+G_STATIC_ASSERT (sizeof (Entry) <= 8 * sizeof (gpointer));
+G_STATIC_ASSERT (sizeof (Group) <= 8 * sizeof (gpointer));
+
+/* one change of a transaction. Nodes that are deleted meanwhile are only
+ * unlinked, so rolling back relinks them and committing frees them */
+struct _Undo
+{
+  UndoOp op;
+  Group *group;
+  Entry *entry;
+
+  /* the node before the unlinked group or entry, or the last
+   * entry of a cleared group, whose first one is @entry */
+  gpointer prev;
+
+  /* the overwritten value */
+  gchar *value;
+};
+
+/* what we know about a file of a writable handle, shared by all handles
+ * and save jobs of the file and dropped when the last of them is gone */
+struct _SavedFile
+{
+  gchar *filename;
+  guint users;
+
+  /* held while the file is written, so jobs of different files
+   * do not wait for each other */
+  GMutex write_lock;
+
+  /* the serial of the newest job written to the file */
+  guint serial;
+
+  /* the file as it was last loaded or written, if known */
+  guint known : 1;
+  XfceRcStamp stamp;
+  guint8 digest[DIGEST_LEN];
+};
+
+/* a piece of a line in the file contents, not nul-terminated */
+struct _Token
+{
+  const gchar *str;
+  gsize len;
+  guint escaped : 1;
 };
 
 
@@ -135,20 +307,102 @@ struct _Group
 
 
 
+/* same as str_is_equal, but @b may be a non-terminated string of @b_len bytes */
+static inline gboolean
+str_is_equal_len (const gchar *a,
+                  const gchar *b,
+                  gssize b_len)
+{
+  if (b_len < 0)
+    return str_is_equal (a, b);
+
+  return strlen (a) == (gsize) b_len && memcmp (a, b, b_len) == 0;
+}
+
+
+
+/* copies @string into the string chunk, @len may be -1 if @string is nul-terminated */
+static inline gchar *
+simple_intern (XfceRcSimple *simple,
+               const gchar *string,
+               gssize len)
+{
+  if (len < 0)
+    {
+      XFCE_RC_STATS_ADD (simple, string_bytes, strlen (string) + 1);
+      return g_string_chunk_insert (simple->string_chunk, string);
+    }
+
+  XFCE_RC_STATS_ADD (simple, string_bytes, len + 1);
+  return g_string_chunk_insert_len (simple->string_chunk, string, len);
+}
+
+
+
+static gpointer
+simple_arena_alloc (XfceRcSimple *simple,
+                    gsize size)
+{
+  gpointer *free_list;
+  gpointer node;
+
+  size = (size + sizeof (gpointer) - 1) & ~(sizeof (gpointer) - 1);
+
+  free_list = &simple->arena_free[size / sizeof (gpointer)];
+  if (*free_list != NULL)
+    {
+      node = *free_list;
+      *free_list = *((gpointer *) node);
+      return node;
+    }
+
+  if (G_UNLIKELY (simple->arena_left < size))
+    {
+      simple->arena_pos = g_malloc (ARENA_BLOCK_SIZE);
+      simple->arena_left = ARENA_BLOCK_SIZE;
+      g_ptr_array_add (simple->arena, simple->arena_pos);
+    }
+
+  node = simple->arena_pos;
+  simple->arena_pos += size;
+  simple->arena_left -= size;
+
+  return node;
+}
+
+
+
+static void
+simple_arena_free (XfceRcSimple *simple,
+                   gpointer node,
+                   gsize size)
+{
+  gpointer *free_list;
+
+  size = (size + sizeof (gpointer) - 1) & ~(sizeof (gpointer) - 1);
+
+  free_list = &simple->arena_free[size / sizeof (gpointer)];
+  *((gpointer *) node) = *free_list;
+  *free_list = node;
+}
+
+
+
+/* appends a new group, @name must stay valid for the lifetime of @simple */
 static Group *
-simple_add_group (XfceRcSimple *simple,
-                  const gchar *name)
+simple_new_group (XfceRcSimple *simple,
+                  gchar *name)
 {
   Group *group;
 
-  for (group = simple->gfirst; group != NULL; group = group->next)
-    if (str_is_equal (group->name, name))
-      return group;
-
-  group = g_slice_new (Group);
-  group->name = g_string_chunk_insert (simple->string_chunk, name);
+  group = arena_new (simple, Group);
+  group->name = name;
   group->efirst = NULL;
   group->elast = NULL;
+  group->entries = g_hash_table_new (g_str_hash, g_str_equal);
+  group->pending = NULL;
+
+  XFCE_RC_STATS_ADD (simple, groups, 1);
 
   if (G_UNLIKELY (simple->gfirst == NULL))
     {
@@ -163,15 +417,73 @@ simple_add_group (XfceRcSimple *simple,
       simple->glast = group;
     }
 
+  /* the key is owned by the string chunk */
+  g_hash_table_insert (simple->groups, group->name, group);
+
   return group;
 }
 
 
 
+static Group *
+simple_add_group (XfceRcSimple *simple,
+                  const gchar *name)
+{
+  Group *group;
+
+  group = g_hash_table_lookup (simple->groups, name);
+  if (group != NULL)
+    return group;
+
+  return simple_new_group (simple, simple_intern (simple, name, -1));
+}
+
+
+
+/* appends a new entry to the current group, @key and @value must stay
+ * valid for the lifetime of @simple */
+static Entry *
+simple_new_entry (XfceRcSimple *simple,
+                  gchar *key,
+                  gchar *value)
+{
+  Entry *entry;
+
+  entry = arena_new (simple, Entry);
+  entry->key = key;
+  entry->value = value;
+  entry->lfirst = NULL;
+  entry->llast = NULL;
+  entry->lbest = NULL;
+  entry->lresolved = FALSE;
+
+  XFCE_RC_STATS_ADD (simple, entries, 1);
+
+  if (simple->group->efirst == NULL)
+    {
+      entry->next = entry->prev = NULL;
+      simple->group->efirst = simple->group->elast = entry;
+    }
+  else
+    {
+      entry->next = NULL;
+      entry->prev = simple->group->elast;
+      simple->group->elast->next = entry;
+      simple->group->elast = entry;
+    }
+
+  g_hash_table_insert (simple->group->entries, entry->key, entry);
+
+  return entry;
+}
+
+
+
 static Entry *
 simple_add_entry (XfceRcSimple *simple,
                   const gchar *key,
                   const gchar *value,
+                  gssize value_len,
                   const gchar *locale)
 {
   LEntry *lentry_before;
@@ -179,30 +491,12 @@ simple_add_entry (XfceRcSimple *simple,
   Entry *entry;
   gint result;
 
-  for (entry = simple->group->efirst; entry != NULL; entry = entry->next)
-    if (str_is_equal (entry->key, key))
-      break;
-
+  entry = g_hash_table_lookup (simple->group->entries, key);
   if (G_UNLIKELY (entry == NULL))
     {
-      entry = g_slice_new (Entry);
-      entry->key = g_string_chunk_insert (simple->string_chunk, key);
-      entry->value = g_string_chunk_insert (simple->string_chunk, value);
-      entry->lfirst = NULL;
-      entry->llast = NULL;
-
-      if (simple->group->efirst == NULL)
-        {
-          entry->next = entry->prev = NULL;
-          simple->group->efirst = simple->group->elast = entry;
-        }
-      else
-        {
-          entry->next = NULL;
-          entry->prev = simple->group->elast;
-          simple->group->elast->next = entry;
-          simple->group->elast = entry;
-        }
+      entry = simple_new_entry (simple,
+                                simple_intern (simple, key, -1),
+                                simple_intern (simple, value, value_len));
 
       if (locale == NULL)
         return entry;
@@ -211,8 +505,11 @@ simple_add_entry (XfceRcSimple *simple,
   if (G_UNLIKELY (locale == NULL))
     {
       /* overwrite existing value */
-      if (!str_is_equal (entry->value, value))
-        entry->value = g_string_chunk_insert (simple->string_chunk, value);
+      if (!str_is_equal_len (entry->value, value, value_len))
+        {
+          simple->garbage += strlen (entry->value) + 1;
+          entry->value = simple_intern (simple, value, value_len);
+        }
     }
   else
     {
@@ -242,9 +539,13 @@ simple_add_entry (XfceRcSimple *simple,
       if (G_LIKELY (lentry == NULL))
         {
           /* create new localized entry */
-          lentry = g_slice_new (LEntry);
-          lentry->locale = g_string_chunk_insert (simple->string_chunk, locale);
-          lentry->value = g_string_chunk_insert (simple->string_chunk, value);
+          lentry = arena_new (simple, LEntry);
+          lentry->locale = simple_intern (simple, locale, -1);
+          lentry->value = simple_intern (simple, value, value_len);
+          XFCE_RC_STATS_ADD (simple, locale_entries, 1);
+
+          /* the new locale may fit better */
+          entry->lresolved = FALSE;
 
           if (G_UNLIKELY (entry->lfirst == NULL))
             {
@@ -272,8 +573,11 @@ simple_add_entry (XfceRcSimple *simple,
       else
         {
           /* overwrite value in existing localized entry */
-          if (G_LIKELY (!str_is_equal (lentry->value, value)))
-            lentry->value = g_string_chunk_insert (simple->string_chunk, value);
+          if (G_LIKELY (!str_is_equal_len (lentry->value, value, value_len)))
+            {
+              simple->garbage += strlen (lentry->value) + 1;
+              lentry->value = simple_intern (simple, value, value_len);
+            }
         }
     }
 
@@ -283,40 +587,42 @@ simple_add_entry (XfceRcSimple *simple,
 
 
 static gboolean
-simple_parse_line (gchar *line,
-                   gchar **section,
-                   gchar **key,
-                   gchar **value,
-                   gchar **locale)
+simple_parse_line (const gchar *line,
+                   const gchar *end,
+                   Token *section,
+                   Token *key,
+                   Token *value,
+                   Token *locale)
 {
-  gchar *p, *q, *r, *s;
+  const gchar *p, *q, *r, *s;
 
   p = line;
 
-  *section = NULL;
-  *locale = NULL;
-  *value = NULL;
-  *key = NULL;
+  section->str = NULL;
+  locale->str = NULL;
+  value->str = NULL;
+  key->str = NULL;
 
-  while (g_ascii_isspace (*p))
+  while (p < end && g_ascii_isspace (*p))
     ++p;
 
-  if (G_UNLIKELY (*p == '\0' || *p == '\n' || *p == '#'))
+  if (G_UNLIKELY (p == end || *p == '#'))
     return FALSE;
 
   if (*p == '[')
     {
-      q = strrchr (++p, ']');
-      if (G_LIKELY (q != NULL))
+      for (q = end, ++p; q > p && *(q - 1) != ']'; --q)
+        ;
+      if (G_LIKELY (q > p))
         {
-          *section = p;
-          *q = '\0';
+          section->str = p;
+          section->len = q - 1 - p;
           return TRUE;
         }
     }
   else
     {
-      q = strchr (p + 1, '=');
+      q = memchr (p + 1, '=', end - p - 1);
       if (G_UNLIKELY (q == NULL))
         return FALSE;
 
@@ -335,73 +641,35 @@ simple_parse_line (gchar *line,
           if (G_UNLIKELY (*s != '['))
             return FALSE;
 
-          *key = p;
-          *s = '\0';
+          key->str = p;
+          key->len = s - p;
 
-          *locale = s + 1;
-          *q = '\0';
+          locale->str = s + 1;
+          locale->len = q - s - 1;
 
-          if (G_UNLIKELY (**key == '\0' || **locale == '\0'))
+          if (G_UNLIKELY (key->len == 0 || locale->len == 0))
             return FALSE;
         }
       else
         {
-          ++q;
-          *key = p;
-          *q = '\0';
+          key->str = p;
+          key->len = q + 1 - p;
         }
 
-      while (g_ascii_isspace (*r))
+      while (r < end && g_ascii_isspace (*r))
         ++r;
 
-      q = r + strlen (r);
+      q = end;
 
       /* "\ " at the end of the string will not be removed */
       while (q > r && ((g_ascii_isspace (*(q - 1)) && *(q - 2) != '\\') || ((*(q - 1)) == '\r')))
         --q;
 
-      *value = r;
-      *q = '\0';
+      value->str = r;
+      value->len = q - r;
 
-      /* unescape \ , \n, \t, \r and \\ */
-      for (p = r; *r != '\0';)
-        {
-          if (G_UNLIKELY (*r == '\\'))
-            {
-              switch (*(r + 1))
-                {
-                case ' ':
-                  *p++ = ' ';
-                  break;
-
-                case 'n':
-                  *p++ = '\n';
-                  break;
-
-                case 't':
-                  *p++ = '\t';
-                  break;
-
-                case 'r':
-                  *p++ = '\r';
-                  break;
-
-                case '\\':
-                  *p++ = '\\';
-                  break;
-
-                default:
-                  *p++ = '\\';
-                  *p++ = *(r + 1);
-                  break;
-                }
-
-              r += 2;
-            }
-          else
-            *p++ = *r++;
-        }
-      *p = '\0';
+      /* only values with backslashes need to be rewritten */
+      value->escaped = memchr (r, '\\', q - r) != NULL;
 
       return TRUE;
     }
@@ -412,71 +680,135 @@ simple_parse_line (gchar *line,
 
 
 static void
-simple_write_escaped (const gchar *string, FILE *fp)
+simple_unescape (const gchar *string,
+                 gsize len,
+                 GString *buffer)
+{
+  const gchar *end = string + len;
+  const gchar *p;
+
+  g_string_truncate (buffer, 0);
+
+  /* unescape \ , \n, \t, \r and \\ */
+  while (string < end)
+    {
+      /* copy everything up to the next backslash in one go */
+      p = memchr (string, '\\', end - string);
+      if (p == NULL)
+        p = end;
+      g_string_append_len (buffer, string, p - string);
+      string = p;
+
+      if (string == end)
+        break;
+
+      if (G_LIKELY (string + 1 < end))
+        {
+          switch (*(string + 1))
+            {
+            case ' ':
+              g_string_append_c (buffer, ' ');
+              break;
+
+            case 'n':
+              g_string_append_c (buffer, '\n');
+              break;
+
+            case 't':
+              g_string_append_c (buffer, '\t');
+              break;
+
+            case 'r':
+              g_string_append_c (buffer, '\r');
+              break;
+
+            case '\\':
+              g_string_append_c (buffer, '\\');
+              break;
+
+            default:
+              g_string_append_c (buffer, '\\');
+              g_string_append_c (buffer, *(string + 1));
+              break;
+            }
+
+          string += 2;
+        }
+      else
+        {
+          /* keep a trailing backslash as is */
+          g_string_append_c (buffer, *string++);
+        }
+    }
+}
+
+
+
+static void
+simple_write_escaped (GString *buffer,
+                      const gchar *string)
 {
-  const gchar *s;
+  const gchar *trailing;
+  const gchar *run;
+
+  /* spaces after the last non-whitespace character need to be escaped,
+   * so look for it once instead of checking ahead at every space */
+  for (trailing = string + strlen (string);
+       trailing > string && g_ascii_isspace (*(trailing - 1));
+       --trailing)
+    ;
 
   /* escape all whitespace at the beginning of the string */
   for (; *string == ' '; ++string)
-    fputs ("\\ ", fp);
-
-  for (; *string != '\0'; ++string)
-    switch (*string)
-      {
-      case ' ':
-        /* check if any non whitespace characters follow */
-        for (s = string + 1; g_ascii_isspace (*s); ++s)
-          ;
-        if (*s == '\0')
-          {
-            /* need to escape the space */
-            fputs ("\\ ", fp);
-          }
-        else
-          {
-            /* still non-whitespace, no need to escape */
-            fputc (' ', fp);
-          }
-        break;
+    g_string_append_len (buffer, "\\ ", 2);
 
-      case '\n':
-        fputs ("\\n", fp);
-        break;
+  for (;; ++string)
+    {
+      /* copy everything that needs no escaping in one go */
+      run = string;
+      string += strcspn (string, " \n\t\r\\");
+      g_string_append_len (buffer, run, string - run);
 
-      case '\t':
-        fputs ("\\t", fp);
-        break;
+      switch (*string)
+        {
+        case '\0':
+          return;
 
-      case '\r':
-        fputs ("\\r", fp);
-        break;
+        case ' ':
+          if (string >= trailing)
+            g_string_append_len (buffer, "\\ ", 2);
+          else
+            g_string_append_c (buffer, ' ');
+          break;
 
-      case '\\':
-        fputs ("\\\\", fp);
-        break;
+        case '\n':
+          g_string_append_len (buffer, "\\n", 2);
+          break;
 
-      default:
-        fputc (*string, fp);
-        break;
-      }
+        case '\t':
+          g_string_append_len (buffer, "\\t", 2);
+          break;
+
+        case '\r':
+          g_string_append_len (buffer, "\\r", 2);
+          break;
+
+        case '\\':
+          g_string_append_len (buffer, "\\\\", 2);
+          break;
+        }
+    }
 }
 
 
 
-static gboolean
-simple_write (XfceRcSimple *simple, const gchar *filename)
+static void
+simple_serialize (XfceRcSimple *simple,
+                  GString *buffer)
 {
   LEntry *lentry;
   Entry *entry;
   Group *group;
-  FILE *fp;
-
-  fp = fopen (filename, "w");
-  if (G_UNLIKELY (fp == NULL))
-    {
-      g_critical ("Unable to open file %s for writing: %s", filename, g_strerror (errno));
-      return FALSE;
-    }
 
   for (group = simple->gfirst; group != NULL; group = group->next)
     {
@@ -486,13 +818,18 @@ simple_write (XfceRcSimple *simple, const gchar *filename)
 
       /* NULL_GROUP has no header */
       if (!str_is_equal (group->name, NULL_GROUP))
-        fprintf (fp, "[%s]\n", group->name);
+        {
+          g_string_append_c (buffer, '[');
+          g_string_append (buffer, group->name);
+          g_string_append_len (buffer, "]\n", 2);
+        }
 
       for (entry = group->efirst; entry != NULL; entry = entry->next)
         {
-          fprintf (fp, "%s=", entry->key);
-          simple_write_escaped (entry->value, fp);
-          fputc ('\n', fp);
+          g_string_append (buffer, entry->key);
+          g_string_append_c (buffer, '=');
+          simple_write_escaped (buffer, entry->value);
+          g_string_append_c (buffer, '\n');
           /*
            * Write local dependent key/value pairs. E.g.
            *   Name[da]=Xfce-session
@@ -501,80 +838,368 @@ simple_write (XfceRcSimple *simple, const gchar *filename)
            */
           for (lentry = entry->lfirst; lentry != NULL; lentry = lentry->next)
             {
-              fprintf (fp, "%s[%s]=", entry->key, lentry->locale);
-              simple_write_escaped (lentry->value, fp);
-              fputc ('\n', fp);
+              g_string_append (buffer, entry->key);
+              g_string_append_c (buffer, '[');
+              g_string_append (buffer, lentry->locale);
+              g_string_append_len (buffer, "]=", 2);
+              simple_write_escaped (buffer, lentry->value);
+              g_string_append_c (buffer, '\n');
             }
         }
 
-      fprintf (fp, "\n");
+      g_string_append_c (buffer, '\n');
     }
+}
+
+
+
+static gboolean
+simple_write_all (gint fd,
+                  const gchar *data,
+                  gsize length)
+{
+  gssize n;
 
-  if (ferror (fp))
+  while (length > 0)
     {
-      g_critical ("Unable to write to file %s: Unexpected internal error", filename);
-      fclose (fp);
-      unlink (filename);
-      return FALSE;
+      n = write (fd, data, length);
+      if (G_UNLIKELY (n < 0))
+        {
+          if (errno == EINTR)
+            continue;
+          return FALSE;
+        }
+
+      data += n;
+      length -= n;
     }
 
-  fclose (fp);
   return TRUE;
 }
 
 
 
-static void
-simple_entry_free (Entry *entry)
+static gboolean
+simple_write_fd (gint fd,
+                 const GString *contents,
+                 XfceRcSyncMode sync_mode)
 {
-  /* release all lentries */
-  g_slice_free_chain (LEntry, entry->lfirst, next);
+  if (!simple_write_all (fd, contents->str, contents->len))
+    return FALSE;
 
-  /* release the entry */
-  g_slice_free (Entry, entry);
+  /* make sure the data is on disk before the file replaces the old one */
+  if (sync_mode != XFCE_RC_SYNC_NONE)
+    {
+#ifdef HAVE_FDATASYNC
+      return fdatasync (fd) == 0;
+#else
+      return fsync (fd) == 0;
+#endif
+    }
+
+  return TRUE;
 }
 
 
 
-static void
-simple_group_free (Group *group)
+#if defined (HAVE_LINKAT) && defined (O_TMPFILE)
+/* writes @contents to an unnamed file in the directory of @filename and only
+ * links it as @filename when it is complete, so even a crash in the middle
+ * never leaves a partial file behind */
+static gboolean
+simple_write_unnamed (const gchar *filename,
+                      const GString *contents,
+                      XfceRcSyncMode sync_mode)
 {
-  Entry *entry;
-  Entry *next;
+  gchar proc_path[64];
+  gchar *dirname;
+  gboolean result;
+  gint fd;
 
-  /* release all entries */
-  for (entry = group->efirst; entry != NULL; entry = next)
-    {
-      /* determine the next entry */
-      next = entry->next;
+  dirname = g_path_get_dirname (filename);
+  fd = open (dirname, O_TMPFILE | O_WRONLY, 0666);
+  g_free (dirname);
 
-      /* release this entry */
-      simple_entry_free (entry);
+  /* not supported by the kernel or the file system */
+  if (fd < 0)
+    return FALSE;
+
+  result = simple_write_fd (fd, contents, sync_mode);
+  if (result)
+    {
+      g_snprintf (proc_path, sizeof (proc_path), "/proc/self/fd/%d", fd);
+      result = linkat (AT_FDCWD, proc_path, AT_FDCWD, filename, AT_SYMLINK_FOLLOW) == 0;
     }
 
-  /* release the group */
-  g_slice_free (Group, group);
+  close (fd);
+
+  return result;
 }
+#endif
 
 
 
-static guint
-xfce_locale_match_rc (const XfceRc *rc, const gchar *locale)
+static gboolean
+simple_write (const gchar *filename,
+              const GString *contents,
+              XfceRcSyncMode sync_mode,
+              GError **error)
 {
-  if (rc->languages != NULL)
+  gboolean result;
+  gint saved_errno;
+  gint fd;
+
+#if defined (HAVE_LINKAT) && defined (O_TMPFILE)
+  if (simple_write_unnamed (filename, contents, sync_mode))
+    return TRUE;
+#endif
+
+  fd = open (filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (G_UNLIKELY (fd < 0))
     {
-      for (gchar **plng = rc->languages; *plng != NULL; plng++)
-        {
-          guint match = xfce_locale_match (*plng, locale);
-          if (match > XFCE_LOCALE_NO_MATCH)
-            return match;
-        }
+      saved_errno = errno;
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (saved_errno),
+                   "Unable to open file %s for writing: %s", filename, g_strerror (saved_errno));
+      return FALSE;
     }
-  else if (rc->locale != NULL)
-    return xfce_locale_match (rc->locale, locale);
 
-  return XFCE_LOCALE_NO_MATCH;
-}
+  result = simple_write_fd (fd, contents, sync_mode);
+
+  if (close (fd) < 0)
+    result = FALSE;
+
+  if (!result)
+    {
+      saved_errno = errno;
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (saved_errno),
+                   "Unable to write to file %s: %s", filename, g_strerror (saved_errno));
+      unlink (filename);
+    }
+
+  return result;
+}
+
+
+
+/* syncs the directory entry of @filename after it was renamed */
+static void
+simple_sync_dir (const gchar *filename)
+{
+  gchar *dirname;
+  gint fd;
+
+  dirname = g_path_get_dirname (filename);
+  fd = open (dirname, O_RDONLY);
+  if (G_LIKELY (fd >= 0))
+    {
+      if (fsync (fd) < 0)
+        g_warning ("Unable to sync directory %s: %s", dirname, g_strerror (errno));
+      close (fd);
+    }
+  g_free (dirname);
+}
+
+
+
+static void
+simple_entry_free (XfceRcSimple *simple,
+                   Entry *entry)
+{
+  LEntry *lentry;
+  LEntry *next;
+
+  simple->garbage += strlen (entry->key) + strlen (entry->value) + 2;
+
+  /* release all lentries */
+  for (lentry = entry->lfirst; lentry != NULL; lentry = next)
+    {
+      next = lentry->next;
+      simple->garbage += strlen (lentry->locale) + strlen (lentry->value) + 2;
+      arena_free (simple, LEntry, lentry);
+    }
+
+  /* release the entry */
+  arena_free (simple, Entry, entry);
+}
+
+
+
+static void
+simple_spans_free (XfceRcSimple *simple,
+                   Span *span)
+{
+  Span *next;
+
+  for (; span != NULL; span = next)
+    {
+      next = span->next;
+      arena_free (simple, Span, span);
+    }
+}
+
+
+
+static void
+simple_group_free (XfceRcSimple *simple,
+                   Group *group)
+{
+  Entry *entry;
+  Entry *next;
+
+  /* release all entries */
+  for (entry = group->efirst; entry != NULL; entry = next)
+    {
+      /* determine the next entry */
+      next = entry->next;
+
+      /* release this entry */
+      simple_entry_free (simple, entry);
+    }
+
+  g_hash_table_destroy (group->entries);
+  simple_spans_free (simple, group->pending);
+  simple->garbage += strlen (group->name) + 1;
+
+  /* release the group */
+  arena_free (simple, Group, group);
+}
+
+
+
+/* An image is a sequence of records, each a type character followed by
+ * nul-terminated strings, in the order they are found in memory:
+ *
+ *   'G' name          a group
+ *   'E' key value     an entry of the last group
+ *   'L' locale value  a localized value of the last entry
+ *   'S' name          the group that is current after parsing
+ */
+static void
+simple_write_image (XfceRcSimple *simple,
+                    GString *payload)
+{
+  const LEntry *lentry;
+  const Entry *entry;
+  const Group *group;
+
+#define APPEND_STRING(string) g_string_append_len (payload, (string), strlen (string) + 1)
+
+  for (group = simple->gfirst; group != NULL; group = group->next)
+    {
+      g_string_append_c (payload, 'G');
+      APPEND_STRING (group->name);
+
+      for (entry = group->efirst; entry != NULL; entry = entry->next)
+        {
+          g_string_append_c (payload, 'E');
+          APPEND_STRING (entry->key);
+          APPEND_STRING (entry->value);
+
+          for (lentry = entry->lfirst; lentry != NULL; lentry = lentry->next)
+            {
+              g_string_append_c (payload, 'L');
+              APPEND_STRING (lentry->locale);
+              APPEND_STRING (lentry->value);
+            }
+        }
+    }
+
+  g_string_append_c (payload, 'S');
+  APPEND_STRING (simple->group->name);
+
+#undef APPEND_STRING
+}
+
+
+
+static void
+simple_read_image (XfceRcSimple *simple,
+                   const gchar *payload,
+                   gsize payload_len)
+{
+  const gchar *end = payload + payload_len;
+  const gchar *p = payload;
+  gchar *strings[2];
+  LEntry *lentry;
+  Entry *entry = NULL;
+  Group *group;
+  gchar type;
+  guint n;
+
+  /* the payload ends with a nul byte (checked by the cache), so each
+   * string we find below is terminated within the image */
+  while (p < end)
+    {
+      type = *p++;
+      for (n = 0; n < ((type == 'E' || type == 'L') ? 2 : 1); ++n)
+        {
+          if (G_UNLIKELY (p >= end))
+            return;
+          strings[n] = (gchar *) p;
+          p += strlen (p) + 1;
+        }
+
+      switch (type)
+        {
+        case 'G':
+          group = g_hash_table_lookup (simple->groups, strings[0]);
+          simple->group = (group != NULL) ? group : simple_new_group (simple, strings[0]);
+          entry = NULL;
+          break;
+
+        case 'E':
+          entry = simple_new_entry (simple, strings[0], strings[1]);
+          break;
+
+        case 'L':
+          if (G_UNLIKELY (entry == NULL))
+            break;
+
+          lentry = arena_new (simple, LEntry);
+          lentry->locale = strings[0];
+          lentry->value = strings[1];
+          XFCE_RC_STATS_ADD (simple, locale_entries, 1);
+          lentry->next = NULL;
+          lentry->prev = entry->llast;
+          if (entry->llast != NULL)
+            entry->llast->next = lentry;
+          else
+            entry->lfirst = lentry;
+          entry->llast = lentry;
+          entry->lresolved = FALSE;
+          break;
+
+        case 'S':
+          group = g_hash_table_lookup (simple->groups, strings[0]);
+          if (G_LIKELY (group != NULL))
+            simple->group = group;
+          break;
+
+        default:
+          return;
+        }
+    }
+}
+
+
+
+static guint
+xfce_locale_match_rc (const XfceRc *rc, const gchar *locale)
+{
+  if (rc->languages != NULL)
+    {
+      for (gchar **plng = rc->languages; *plng != NULL; plng++)
+        {
+          guint match = xfce_locale_match (*plng, locale);
+          if (match > XFCE_LOCALE_NO_MATCH)
+            return match;
+        }
+    }
+  else if (rc->locale != NULL)
+    return xfce_locale_match (rc->locale, locale);
+
+  return XFCE_LOCALE_NO_MATCH;
+}
 
 
 
@@ -600,14 +1225,23 @@ _xfce_rc_simple_new (XfceRcSimple *shared,
   simple->__parent__.delete_entry = _xfce_rc_simple_delete_entry;
   simple->__parent__.has_entry = _xfce_rc_simple_has_entry;
   simple->__parent__.read_entry = _xfce_rc_simple_read_entry;
+  simple->__parent__.lookup = _xfce_rc_simple_lookup;
+  simple->__parent__.get_layers = _xfce_rc_simple_get_layers;
+  simple->__parent__.iter_init = _xfce_rc_simple_iter_init;
+  simple->__parent__.compact = _xfce_rc_simple_compact;
+  simple->__parent__.iter_next = _xfce_rc_simple_iter_next;
 
   if (!readonly)
     {
       simple->__parent__.flush = _xfce_rc_simple_flush;
       simple->__parent__.rollback = _xfce_rc_simple_rollback;
+      simple->__parent__.begin = _xfce_rc_simple_begin;
+      simple->__parent__.commit = _xfce_rc_simple_commit;
       simple->__parent__.is_dirty = _xfce_rc_simple_is_dirty;
       simple->__parent__.is_readonly = _xfce_rc_simple_is_readonly;
       simple->__parent__.write_entry = _xfce_rc_simple_write_entry;
+      simple->__parent__.save_job = _xfce_rc_simple_save_job;
+      simple->__parent__.save_failed = _xfce_rc_simple_save_failed;
     }
 
   if (shared != NULL)
@@ -617,17 +1251,648 @@ _xfce_rc_simple_new (XfceRcSimple *shared,
     }
   else
     {
-      simple->shared_chunks = FALSE;
-      simple->string_chunk = g_string_chunk_new (4096);
+      simple->shared_chunks = FALSE;
+      simple->string_chunk = g_string_chunk_new (4096);
+    }
+
+  /* handles parsed from memory have no file */
+  if (filename != NULL)
+    simple->filename = g_string_chunk_insert (simple->string_chunk, filename);
+  simple->readonly = readonly;
+
+  if (filename != NULL && !readonly)
+    {
+      G_LOCK (saved_files);
+      simple->saved = simple_ref_saved_file (filename);
+      G_UNLOCK (saved_files);
+    }
+  simple->groups = g_hash_table_new (g_str_hash, g_str_equal);
+  simple->arena = g_ptr_array_new_with_free_func (g_free);
+
+  /* add NULL_GROUP */
+  simple->group = simple_add_group (simple, NULL_GROUP);
+
+  return simple;
+}
+
+
+
+static GHashTable *
+simple_string_set_new (const gchar *const *strings)
+{
+  GHashTable *set;
+
+  set = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  for (; *strings != NULL; ++strings)
+    g_hash_table_add (set, g_strdup (*strings));
+
+  return set;
+}
+
+
+
+/* restricts the following parses of @simple to the entries of @groups
+ * and @keys, either may be NULL to keep all of them */
+void
+_xfce_rc_simple_set_projection (XfceRcSimple *simple,
+                                const gchar *const *groups,
+                                const gchar *const *keys)
+{
+  _xfce_return_if_fail (simple != NULL);
+  _xfce_return_if_fail (simple->keep_groups == NULL && simple->keep_keys == NULL);
+
+  if (groups != NULL)
+    simple->keep_groups = simple_string_set_new (groups);
+  if (keys != NULL)
+    simple->keep_keys = simple_string_set_new (keys);
+
+  /* entries before the first section header are in no kept group */
+  simple->skip_group = groups != NULL;
+}
+
+
+
+/* makes the following parses of @simple use an image in the runtime
+ * directory, which all processes of the session map */
+void
+_xfce_rc_simple_set_shared_image (XfceRcSimple *simple)
+{
+  _xfce_return_if_fail (simple != NULL);
+  _xfce_return_if_fail (simple->readonly);
+
+  simple->shared_image = TRUE;
+}
+
+
+
+static void
+simple_parse_range (XfceRcSimple *simple,
+                    const gchar *start,
+                    const gchar *end)
+{
+  gboolean readonly;
+  const gchar *line;
+  const gchar *next;
+  GString *key_buffer;
+  GString *locale_buffer;
+  GString *value_buffer;
+  Token section;
+  Token locale;
+  Token value;
+  Token key;
+  XfceRc *rc;
+  guint64 n_lines = 0;
+
+  rc = XFCE_RC (simple);
+  readonly = xfce_rc_is_readonly (rc);
+
+  key_buffer = g_string_sized_new (64);
+  locale_buffer = g_string_sized_new (16);
+  value_buffer = g_string_sized_new (256);
+
+  for (line = start; line < end; line = next)
+    {
+      /* the line includes its newline, like getline() did */
+      next = memchr (line, '\n', end - line);
+      next = (next != NULL) ? next + 1 : end;
+      n_lines++;
+
+      if (!simple_parse_line (line, next, &section, &key, &value, &locale))
+        continue;
+
+      if (section.str != NULL)
+        {
+          g_string_truncate (key_buffer, 0);
+          g_string_append_len (key_buffer, section.str, section.len);
+
+          /* the entries of groups that are not kept are skipped
+           * up to the next section header */
+          simple->skip_group = simple->keep_groups != NULL
+                               && !g_hash_table_contains (simple->keep_groups, key_buffer->str);
+          if (!simple->skip_group)
+            simple->group = simple_add_group (simple, key_buffer->str);
+          continue;
+        }
+
+      if (key.str == NULL || simple->skip_group)
+        continue;
+
+      if (locale.str != NULL)
+        {
+          if (rc->locale == NULL && rc->languages == NULL)
+            continue;
+
+          g_string_truncate (locale_buffer, 0);
+          g_string_append_len (locale_buffer, locale.str, locale.len);
+
+          if (readonly && xfce_locale_match_rc (rc, locale_buffer->str) == XFCE_LOCALE_NO_MATCH)
+            continue;
+        }
+
+      g_string_truncate (key_buffer, 0);
+      g_string_append_len (key_buffer, key.str, key.len);
+
+      if (simple->keep_keys != NULL && !g_hash_table_contains (simple->keep_keys, key_buffer->str))
+        continue;
+
+      /* values without escapes are inserted right from the buffer */
+      if (G_UNLIKELY (value.escaped))
+        {
+          simple_unescape (value.str, value.len, value_buffer);
+          value.str = value_buffer->str;
+          value.len = value_buffer->len;
+        }
+
+      simple_add_entry (simple, key_buffer->str, value.str, value.len,
+                        locale.str != NULL ? locale_buffer->str : NULL);
+    }
+
+  g_string_free (key_buffer, TRUE);
+  g_string_free (locale_buffer, TRUE);
+  g_string_free (value_buffer, TRUE);
+
+  XFCE_RC_STATS_ADD (simple, bytes_parsed, end - start);
+  XFCE_RC_STATS_ADD (simple, lines_parsed, n_lines);
+}
+
+
+
+/* the start time of a parse, if statistics are enabled */
+static inline gint64
+simple_stats_clock (XfceRcSimple *simple)
+{
+  if (G_UNLIKELY (XFCE_RC (simple)->stats != NULL))
+    return g_get_monotonic_time ();
+
+  return 0;
+}
+
+
+
+static void
+simple_stats_parsed (XfceRcSimple *simple,
+                     gint64 start)
+{
+  if (G_LIKELY (XFCE_RC (simple)->stats == NULL))
+    return;
+
+  XFCE_RC (simple)->stats->parse_usec += g_get_monotonic_time () - start;
+  _xfce_rc_stats_publish (XFCE_RC (simple));
+}
+
+
+
+/* runs the tokenizer of simple_parse_range() without building anything,
+ * returns FALSE if a callback of @parser asked to stop */
+gboolean
+_xfce_rc_simple_parse_events (const gchar *start,
+                              const gchar *end,
+                              const XfceRcParser *parser,
+                              gpointer user_data)
+{
+  const gchar *line;
+  const gchar *next;
+  GString *key_buffer;
+  GString *locale_buffer;
+  GString *value_buffer;
+  gboolean result = TRUE;
+  Token section;
+  Token locale;
+  Token value;
+  Token key;
+
+  key_buffer = g_string_sized_new (64);
+  locale_buffer = g_string_sized_new (16);
+  value_buffer = g_string_sized_new (256);
+
+  for (line = start; result && line < end; line = next)
+    {
+      next = memchr (line, '\n', end - line);
+      next = (next != NULL) ? next + 1 : end;
+
+      if (!simple_parse_line (line, next, &section, &key, &value, &locale))
+        continue;
+
+      if (section.str != NULL)
+        {
+          if (parser->group != NULL)
+            {
+              g_string_truncate (key_buffer, 0);
+              g_string_append_len (key_buffer, section.str, section.len);
+              result = (*parser->group) (key_buffer->str, user_data);
+            }
+          continue;
+        }
+
+      if (key.str == NULL
+          || (locale.str == NULL && parser->entry == NULL)
+          || (locale.str != NULL && parser->locale_entry == NULL))
+        continue;
+
+      g_string_truncate (key_buffer, 0);
+      g_string_append_len (key_buffer, key.str, key.len);
+
+      /* the callbacks get nul-terminated values, so always copy */
+      if (G_UNLIKELY (value.escaped))
+        simple_unescape (value.str, value.len, value_buffer);
+      else
+        {
+          g_string_truncate (value_buffer, 0);
+          g_string_append_len (value_buffer, value.str, value.len);
+        }
+
+      if (locale.str != NULL)
+        {
+          g_string_truncate (locale_buffer, 0);
+          g_string_append_len (locale_buffer, locale.str, locale.len);
+          result = (*parser->locale_entry) (key_buffer->str, locale_buffer->str,
+                                            value_buffer->str, user_data);
+        }
+      else
+        {
+          result = (*parser->entry) (key_buffer->str, value_buffer->str, user_data);
+        }
+    }
+
+  g_string_free (key_buffer, TRUE);
+  g_string_free (locale_buffer, TRUE);
+  g_string_free (value_buffer, TRUE);
+
+  return result;
+}
+
+
+
+static void
+simple_digest (const gchar *data,
+               gsize length,
+               guint8 *digest)
+{
+  GChecksum *checksum;
+  gsize digest_len = DIGEST_LEN;
+
+  checksum = g_checksum_new (G_CHECKSUM_SHA256);
+  g_checksum_update (checksum, (const guchar *) data, length);
+  g_checksum_get_digest (checksum, digest, &digest_len);
+  g_checksum_free (checksum);
+}
+
+
+
+static void
+simple_saved_file_free (SavedFile *saved)
+{
+  g_mutex_clear (&saved->write_lock);
+  g_free (saved->filename);
+  g_free (saved);
+}
+
+
+
+/* must be called with the saved_files lock held */
+static SavedFile *
+simple_ref_saved_file (const gchar *filename)
+{
+  SavedFile *saved;
+
+  if (G_UNLIKELY (saved_files == NULL))
+    saved_files = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                                         (GDestroyNotify) simple_saved_file_free);
+
+  saved = g_hash_table_lookup (saved_files, filename);
+  if (saved == NULL)
+    {
+      saved = g_new0 (SavedFile, 1);
+      saved->filename = g_strdup (filename);
+      g_mutex_init (&saved->write_lock);
+      g_hash_table_insert (saved_files, saved->filename, saved);
+    }
+
+  saved->users++;
+
+  return saved;
+}
+
+
+
+static void
+simple_unref_saved_file (SavedFile *saved)
+{
+  G_LOCK (saved_files);
+  if (--saved->users == 0)
+    g_hash_table_remove (saved_files, saved->filename);
+  G_UNLOCK (saved_files);
+}
+
+
+
+/* remembers what the file of @simple contained when it was loaded,
+ * see _xfce_rc_save_job_run() */
+static void
+simple_remember_contents (XfceRcSimple *simple,
+                          const XfceRcStamp *stamp,
+                          const guint8 *digest)
+{
+  G_LOCK (saved_files);
+  simple->saved->known = TRUE;
+  simple->saved->stamp = *stamp;
+  memcpy (simple->saved->digest, digest, DIGEST_LEN);
+  G_UNLOCK (saved_files);
+}
+
+
+
+/* @digest is set to the digest of the file for writable handles, else zeroed */
+static gboolean
+simple_parse_file (XfceRcSimple *simple,
+                   guint8 *digest)
+{
+  XfceRcStamp stamp;
+  gboolean remember;
+  gchar *contents;
+  gsize length;
+
+  /* the stamp is taken first, so if the file changes meanwhile, it
+   * does not match the next time and the file is written anyway */
+  remember = !simple->readonly && _xfce_rc_stamp_init (&stamp, simple->filename);
+  memset (digest, 0, DIGEST_LEN);
+
+  /* read the file in one piece and tokenize straight from the buffer; it
+   * is not mapped, since a file truncated while we parse it would crash
+   * us with SIGBUS */
+  if (!g_file_get_contents (simple->filename, &contents, &length, NULL))
+    return FALSE;
+
+  simple_parse_range (simple, contents, contents + length);
+
+  if (remember)
+    {
+      simple_digest (contents, length, digest);
+      simple_remember_contents (simple, &stamp, digest);
+    }
+
+  g_free (contents);
+
+  return TRUE;
+}
+
+
+
+/* parses the complete lines in @data, may be called repeatedly */
+void
+_xfce_rc_simple_parse_data (XfceRcSimple *simple,
+                            const gchar *data,
+                            gsize length)
+{
+  gint64 start;
+
+  start = simple_stats_clock (simple);
+  simple_parse_range (simple, data, data + length);
+  simple_stats_parsed (simple, start);
+}
+
+
+
+/* remembers the body of @group for simple_load_group() */
+static void
+simple_add_span (XfceRcSimple *simple,
+                 Group *group,
+                 const gchar *start,
+                 const gchar *end)
+{
+  Span *span;
+  Span *last;
+
+  if (start == end)
+    return;
+
+  span = arena_new (simple, Span);
+  span->start = start;
+  span->end = end;
+  span->next = NULL;
+
+  /* a group may appear more than once in the file */
+  if (G_LIKELY (group->pending == NULL))
+    {
+      group->pending = span;
+      simple->n_pending++;
+    }
+  else
+    {
+      for (last = group->pending; last->next != NULL; last = last->next)
+        ;
+      last->next = span;
+    }
+}
+
+
+
+static void
+simple_drop_pending (XfceRcSimple *simple,
+                     Group *group)
+{
+  if (group->pending == NULL)
+    return;
+
+  simple_spans_free (simple, group->pending);
+  group->pending = NULL;
+
+  /* all strings were copied into the string chunk, so the
+   * contents can go once the last group is loaded */
+  if (--simple->n_pending == 0 && simple->source != NULL)
+    {
+      g_bytes_unref (simple->source);
+      simple->source = NULL;
+    }
+}
+
+
+
+/* parses the body of @group, if that did not happen yet */
+static void
+simple_load_group (XfceRcSimple *simple,
+                   Group *group)
+{
+  Group *current;
+  Span *span;
+  gint64 start;
+
+  if (G_LIKELY (group->pending == NULL))
+    return;
+
+  start = simple_stats_clock (simple);
+
+  /* spans never contain section headers, so all entries end up in @group */
+  current = simple->group;
+  simple->group = group;
+  for (span = group->pending; span != NULL; span = span->next)
+    simple_parse_range (simple, span->start, span->end);
+  simple->group = current;
+
+  simple_drop_pending (simple, group);
+  simple_stats_parsed (simple, start);
+}
+
+
+
+static void
+simple_load_all (XfceRcSimple *simple)
+{
+  Group *group;
+
+  for (group = simple->gfirst; group != NULL && simple->n_pending > 0; group = group->next)
+    simple_load_group (simple, group);
+}
+
+
+
+/* the parsed contents depend on the mode and locale of @simple */
+static gchar *
+simple_get_image_variant (XfceRcSimple *simple)
+{
+  XfceRc *rc = XFCE_RC (simple);
+  gchar *languages;
+  gchar *variant;
+
+  languages = (rc->languages != NULL) ? g_strjoinv (":", rc->languages) : NULL;
+  variant = g_strdup_printf ("%s\n%s\n%s",
+                             xfce_rc_is_readonly (rc) ? "ro" : "rw",
+                             rc->locale != NULL ? rc->locale : "",
+                             languages != NULL ? languages : "");
+  g_free (languages);
+
+  return variant;
+}
+
+
+
+/* points the strings of @simple into @payload, the image just written
+ * from it, so they are not kept twice */
+static void
+simple_adopt_image (XfceRcSimple *simple,
+                    GBytes *payload)
+{
+  const gchar *p = g_bytes_get_data (payload, NULL);
+  GStringChunk *old_chunk;
+  LEntry *lentry;
+  Entry *entry;
+  Group *group;
+
+  /* the chunk is shared with other layers and cannot be freed */
+  if (simple->shared_chunks)
+    return;
+
+#define ADOPT_STRING(string) \
+  G_STMT_START { (string) = (gchar *) p; p += strlen (p) + 1; } G_STMT_END
+
+  /* simple_write_image() wrote the records in this order */
+  for (group = simple->gfirst; group != NULL; group = group->next)
+    {
+      ++p;
+      ADOPT_STRING (group->name);
+      g_hash_table_replace (simple->groups, group->name, group);
+
+      for (entry = group->efirst; entry != NULL; entry = entry->next)
+        {
+          ++p;
+          ADOPT_STRING (entry->key);
+          ADOPT_STRING (entry->value);
+          g_hash_table_replace (group->entries, entry->key, entry);
+
+          for (lentry = entry->lfirst; lentry != NULL; lentry = lentry->next)
+            {
+              ++p;
+              ADOPT_STRING (lentry->locale);
+              ADOPT_STRING (lentry->value);
+            }
+        }
+    }
+
+#undef ADOPT_STRING
+
+  /* only the filename is left in the chunk */
+  old_chunk = simple->string_chunk;
+  simple->string_chunk = g_string_chunk_new (4096);
+  simple->filename = g_string_chunk_insert (simple->string_chunk, simple->filename);
+  g_string_chunk_free (old_chunk);
+
+  simple->image = g_bytes_ref (payload);
+  simple->garbage = 0;
+}
+
+
+
+static gboolean
+simple_parse (XfceRcSimple *simple)
+{
+  guint8 digest[DIGEST_LEN];
+  XfceRcStamp stamp;
+  gboolean use_memory;
+  gboolean use_disk;
+  gboolean seen;
+  GString *image;
+  GBytes *payload;
+  gchar *variant;
+  gboolean result;
+
+  /* only files opened read-only are shared within the process, and
+   * the images always hold all entries */
+  use_memory = simple->readonly && simple->keep_groups == NULL && simple->keep_keys == NULL;
+  use_disk = _xfce_rc_cache_enabled () && simple->keep_groups == NULL && simple->keep_keys == NULL;
+
+  if ((!use_memory && !use_disk) || !_xfce_rc_stamp_init (&stamp, simple->filename))
+    return simple_parse_file (simple, digest);
+
+  /* use a compiled image if the file did not change since it was made */
+  variant = simple_get_image_variant (simple);
+  if (use_memory)
+    {
+      simple->image = _xfce_rc_memory_cache_lookup (simple->filename, variant, &stamp, &seen);
+
+      /* keep an image of files opened more than once, and of the system
+       * files every config handle reads, but not of one-off opens */
+      use_memory = seen || simple->shared_image;
+    }
+  if (simple->image == NULL && use_disk)
+    {
+      simple->image = _xfce_rc_cache_lookup (simple->filename, variant, simple->shared_image, &stamp, digest);
+      if (simple->image != NULL && use_memory)
+        _xfce_rc_memory_cache_store (simple->filename, variant, &stamp, simple->image);
+
+      /* the image of a writable handle has the digest of the file, so the
+       * next flush can still tell whether the contents changed */
+      if (simple->image != NULL && !simple->readonly)
+        simple_remember_contents (simple, &stamp, digest);
+    }
+
+  if (simple->image != NULL)
+    {
+      simple_read_image (simple, g_bytes_get_data (simple->image, NULL), g_bytes_get_size (simple->image));
+      g_free (variant);
+      return TRUE;
     }
 
-  simple->filename = g_string_chunk_insert (simple->string_chunk, filename);
-  simple->readonly = readonly;
+  result = simple_parse_file (simple, digest);
+  if (result && (use_memory || use_disk))
+    {
+      image = g_string_sized_new (4096);
+      simple_write_image (simple, image);
+      if (use_disk)
+        _xfce_rc_cache_store (simple->filename, variant, simple->shared_image, &stamp, digest, image);
+      if (use_memory)
+        {
+          payload = g_string_free_to_bytes (image);
+          _xfce_rc_memory_cache_store (simple->filename, variant, &stamp, payload);
+          simple_adopt_image (simple, payload);
+          g_bytes_unref (payload);
+        }
+      else
+        g_string_free (image, TRUE);
+    }
 
-  /* add NULL_GROUP */
-  simple->group = simple_add_group (simple, NULL_GROUP);
+  g_free (variant);
 
-  return simple;
+  return result;
 }
 
 
@@ -635,57 +1900,89 @@ _xfce_rc_simple_new (XfceRcSimple *shared,
 gboolean
 _xfce_rc_simple_parse (XfceRcSimple *simple)
 {
-  gboolean readonly;
-  gchar *line = NULL;
-  size_t line_len;
-  gchar *section;
-  gchar *locale;
-  gchar *value;
-  gchar *key;
-  XfceRc *rc;
-  FILE *fp;
+  gboolean result;
+  gint64 start;
 
   _xfce_return_val_if_fail (simple != NULL, FALSE);
   _xfce_return_val_if_fail (simple->filename != NULL, FALSE);
 
-  rc = XFCE_RC (simple);
-  readonly = xfce_rc_is_readonly (rc);
+  start = simple_stats_clock (simple);
+  result = simple_parse (simple);
+  simple_stats_parsed (simple, start);
+
+  return result;
+}
+
+
+
+/* only looks for the section headers, the groups are parsed on first use */
+gboolean
+_xfce_rc_simple_parse_lazy (XfceRcSimple *simple)
+{
+  const gchar *body;
+  const gchar *end;
+  const gchar *line;
+  const gchar *next;
+  const gchar *p;
+  GString *name;
+  Group *group;
+  Token section;
+  Token locale;
+  Token value;
+  Token key;
+  gchar *contents;
+  gsize length;
+  gint64 start;
+
+  _xfce_return_val_if_fail (simple != NULL, FALSE);
+  _xfce_return_val_if_fail (simple->filename != NULL, FALSE);
+
+  start = simple_stats_clock (simple);
 
-  fp = fopen (simple->filename, "r");
-  if (fp == NULL)
+  /* unlike a mapping, a copy survives the file being truncated */
+  if (!g_file_get_contents (simple->filename, &contents, &length, NULL))
     return FALSE;
 
-  while (getline (&line, &line_len, fp) != -1)
-    {
-      if (!simple_parse_line (line, &section, &key, &value, &locale))
-        continue;
+  end = contents + length;
 
-      if (section != NULL)
-        {
-          simple->group = simple_add_group (simple, section);
-          continue;
-        }
+  name = g_string_sized_new (64);
+  group = simple->group;
+  body = contents;
 
-      if (key == NULL)
-        continue;
+  for (line = contents; line < end; line = next)
+    {
+      next = memchr (line, '\n', end - line);
+      next = (next != NULL) ? next + 1 : end;
 
-      if (locale == NULL)
-        {
-          simple_add_entry (simple, key, value, NULL);
-          continue;
-        }
+      /* skip everything that cannot be a section header */
+      for (p = line; p < next && g_ascii_isspace (*p); ++p)
+        ;
+      if (G_LIKELY (p == next || *p != '['))
+        continue;
 
-      if (rc->locale == NULL && rc->languages == NULL)
+      if (!simple_parse_line (line, next, &section, &key, &value, &locale))
         continue;
 
-      if (!readonly || xfce_locale_match_rc (rc, locale) > XFCE_LOCALE_NO_MATCH)
-        simple_add_entry (simple, key, value, locale);
+      simple_add_span (simple, group, body, line);
+
+      g_string_truncate (name, 0);
+      g_string_append_len (name, section.str, section.len);
+      group = simple_add_group (simple, name->str);
+      body = next;
     }
 
-  if (line != NULL)
-    free (line);
+  simple_add_span (simple, group, body, end);
+  g_string_free (name, TRUE);
 
-  fclose (fp);
+  /* same as after a full parse, the last group is the current one */
+  simple->group = group;
+
+  if (simple->n_pending > 0)
+    simple->source = g_bytes_new_take (contents, length);
+  else
+    g_free (contents);
+
+  simple_stats_parsed (simple, start);
 
   return TRUE;
 }
@@ -696,18 +1993,28 @@ void
 _xfce_rc_simple_close (XfceRc *rc)
 {
   XfceRcSimple *simple = XFCE_RC_SIMPLE (rc);
-  Group *group_next;
   Group *group;
 
-  /* release all memory allocated to the groups */
-  for (group = simple->gfirst; group != NULL; group = group_next)
-    {
-      /* determine the next group */
-      group_next = group->next;
+  /* the groups deleted in an open transaction have indexes as well */
+  _xfce_rc_simple_commit (rc);
 
-      /* release this group */
-      simple_group_free (group);
-    }
+  /* the nodes go with the arena, only the entry indexes are separate */
+  for (group = simple->gfirst; group != NULL; group = group->next)
+    g_hash_table_destroy (group->entries);
+
+  g_hash_table_destroy (simple->groups);
+  g_ptr_array_free (simple->arena, TRUE);
+
+  if (simple->image != NULL)
+    g_bytes_unref (simple->image);
+  if (simple->source != NULL)
+    g_bytes_unref (simple->source);
+  if (simple->keep_groups != NULL)
+    g_hash_table_unref (simple->keep_groups);
+  if (simple->keep_keys != NULL)
+    g_hash_table_unref (simple->keep_keys);
+  if (simple->saved != NULL)
+    simple_unref_saved_file (simple->saved);
 
   /* release the string chunk */
   if (!simple->shared_chunks)
@@ -720,30 +2027,427 @@ void
 _xfce_rc_simple_flush (XfceRc *rc)
 {
   XfceRcSimple *simple = XFCE_RC_SIMPLE (rc);
-  gchar *filename = simple->filename;
-  gchar tmp_path[PATH_MAX], buf[PATH_MAX] = { 0 };
+  XfceRcSaveJob *job;
+  GError *error = NULL;
+  gboolean written;
+  gint64 start = 0;
 
-  if (G_UNLIKELY (!simple->dirty))
+  job = _xfce_rc_simple_save_job (rc);
+  if (G_UNLIKELY (job == NULL))
     return;
 
-  g_snprintf (tmp_path, PATH_MAX, "%s.%d.tmp", simple->filename, (int) getpid ());
-  if (simple_write (simple, tmp_path))
+  if (G_UNLIKELY (rc->stats != NULL))
+    start = g_get_monotonic_time ();
+
+  if (!_xfce_rc_save_job_run (job, &written, &error))
+    {
+      g_critical ("%s", error->message);
+      g_error_free (error);
+
+      /* still not on disk */
+      simple->dirty = TRUE;
+    }
+  else if (G_UNLIKELY (rc->stats != NULL) && written)
+    {
+      rc->stats->flushes += 1;
+      rc->stats->bytes_flushed += job->contents->len;
+      rc->stats->flush_usec += g_get_monotonic_time () - start;
+      _xfce_rc_stats_publish (rc);
+    }
+
+  _xfce_rc_save_job_free (job);
+}
+
+
+
+XfceRcSaveJob *
+_xfce_rc_simple_save_job (XfceRc *rc)
+{
+  XfceRcSimple *simple = XFCE_RC_SIMPLE (rc);
+  XfceRcSaveJob *job;
+
+  if (!simple->dirty)
+    return NULL;
+
+  /* groups of a lazy handle that were never touched are written too */
+  simple_load_all (simple);
+
+  job = g_slice_new (XfceRcSaveJob);
+  job->filename = g_strdup (simple->filename);
+  job->contents = g_string_sized_new (4096);
+  job->sync_mode = rc->sync_mode;
+  job->serial = g_atomic_int_add (&save_serial, 1);
+  simple_serialize (simple, job->contents);
+
+  /* the job keeps what we know about the file until it is freed */
+  G_LOCK (saved_files);
+  simple_ref_saved_file (job->filename);
+  G_UNLOCK (saved_files);
+
+  simple->last_serial = job->serial;
+
+  /* from now on, writing the file is up to the owner of the job */
+  simple->dirty = FALSE;
+
+  /* the file no longer has the contents a rollback returns to */
+  simple->undo_dirty = TRUE;
+
+  return job;
+}
+
+
+
+void
+_xfce_rc_simple_save_failed (XfceRc *rc,
+                             guint serial)
+{
+  XfceRcSimple *simple = XFCE_RC_SIMPLE (rc);
+
+  /* a later job has all changes of this one */
+  if (simple->last_serial == serial)
+    simple->dirty = TRUE;
+}
+
+
+
+/* whether the file of @rc is still the one its last save job wrote */
+gboolean
+_xfce_rc_simple_is_saved (const XfceRc *rc)
+{
+  const XfceRcSimple *simple = XFCE_RC_SIMPLE_CONST (rc);
+  SavedFile *saved = simple->saved;
+  XfceRcStamp stamp;
+  gboolean result = FALSE;
+
+  if (simple->last_serial == 0 || !_xfce_rc_stamp_init (&stamp, simple->filename))
+    return FALSE;
+
+  G_LOCK (saved_files);
+  if (saved->known
+      && saved->serial == simple->last_serial
+      && _xfce_rc_stamp_equal (&saved->stamp, &stamp))
+    result = TRUE;
+  G_UNLOCK (saved_files);
+
+  return result;
+}
+
+
+
+/* support rc file being a symlink: see bug #14698 */
+static gchar *
+simple_resolve_symlink (const gchar *filename)
+{
+  gchar *dirname;
+  gchar *target;
+  gchar *path;
+
+  target = g_file_read_link (filename, NULL);
+  if (target == NULL)
+    return g_strdup (filename);
+
+  if (g_path_is_absolute (target))
+    return target;
+
+  /* relative links are relative to the directory of the link */
+  dirname = g_path_get_dirname (filename);
+  path = g_build_filename (dirname, target, NULL);
+  g_free (dirname);
+  g_free (target);
+
+  return path;
+}
+
+
+
+gboolean
+_xfce_rc_save_job_run (const XfceRcSaveJob *job,
+                       gboolean *written,
+                       GError **error)
+{
+  guint8 digest[DIGEST_LEN];
+  XfceRcStamp saved_stamp;
+  XfceRcStamp stamp;
+  SavedFile *saved;
+  gboolean result = TRUE;
+  gboolean unchanged;
+  gboolean known;
+  gint saved_errno;
+  gchar *tmp_path;
+  gchar *target;
+
+  if (written != NULL)
+    *written = FALSE;
+
+  simple_digest (job->contents->str, job->contents->len, digest);
+
+  /* the job holds a reference, see _xfce_rc_simple_save_job() */
+  G_LOCK (saved_files);
+  saved = g_hash_table_lookup (saved_files, job->filename);
+  G_UNLOCK (saved_files);
+
+  /* jobs of the same file may be saved from different threads, make
+   * sure that an older one never replaces the contents of a newer one */
+  g_mutex_lock (&saved->write_lock);
+
+  G_LOCK (saved_files);
+  if (saved->serial > job->serial)
+    {
+      G_UNLOCK (saved_files);
+      g_mutex_unlock (&saved->write_lock);
+      return TRUE;
+    }
+  unchanged = saved->known && memcmp (saved->digest, digest, DIGEST_LEN) == 0;
+  saved_stamp = saved->stamp;
+  G_UNLOCK (saved_files);
+
+  /* rewriting a file with the same contents would only wake up everyone
+   * who watches it, so skip that if the file did not change since we
+   * loaded or wrote it */
+  if (unchanged
+      && _xfce_rc_stamp_init (&stamp, job->filename)
+      && _xfce_rc_stamp_equal (&stamp, &saved_stamp))
+    {
+      G_LOCK (saved_files);
+      saved->serial = job->serial;
+      G_UNLOCK (saved_files);
+      g_mutex_unlock (&saved->write_lock);
+      return TRUE;
+    }
+
+  /* the temporary file has to be in the same directory as the file it replaces */
+  target = simple_resolve_symlink (job->filename);
+  tmp_path = g_strdup_printf ("%s.%d.%u.tmp", target, (int) getpid (), job->serial);
+
+  if (!simple_write (tmp_path, job->contents, job->sync_mode, error))
+    {
+      result = FALSE;
+    }
+  else
     {
-      /* support rc file being a symlink: see bug #14698 */
-      if (readlink (simple->filename, buf, sizeof (buf) - 1) != -1)
-        filename = buf;
+      /* the file keeps inode and modification time when renamed */
+      known = _xfce_rc_stamp_init (&stamp, tmp_path);
 
-      if (rename (tmp_path, filename) < 0)
+      if (rename (tmp_path, target) < 0)
         {
-          g_critical ("Unable to rename %s to %s: %s",
-                      tmp_path,
-                      filename,
-                      g_strerror (errno));
+          saved_errno = errno;
+          g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (saved_errno),
+                       "Unable to rename %s to %s: %s", tmp_path, target, g_strerror (saved_errno));
           unlink (tmp_path);
+          result = FALSE;
         }
       else
-        simple->dirty = FALSE;
+        {
+          if (job->sync_mode == XFCE_RC_SYNC_FULL)
+            simple_sync_dir (target);
+
+          if (written != NULL)
+            *written = TRUE;
+        }
+    }
+
+  G_LOCK (saved_files);
+  if (result)
+    {
+      saved->serial = job->serial;
+      saved->known = known;
+      saved->stamp = stamp;
+      memcpy (saved->digest, digest, DIGEST_LEN);
+    }
+  else
+    {
+      /* the previous contents are unknown after a failure */
+      saved->known = FALSE;
+    }
+  G_UNLOCK (saved_files);
+
+  g_mutex_unlock (&saved->write_lock);
+
+  g_free (tmp_path);
+  g_free (target);
+
+  return result;
+}
+
+
+
+void
+_xfce_rc_save_job_free (XfceRcSaveJob *job)
+{
+  SavedFile *saved;
+
+  G_LOCK (saved_files);
+  saved = g_hash_table_lookup (saved_files, job->filename);
+  G_UNLOCK (saved_files);
+  simple_unref_saved_file (saved);
+
+  g_free (job->filename);
+  g_string_free (job->contents, TRUE);
+  g_slice_free (XfceRcSaveJob, job);
+}
+
+
+
+static void
+simple_log (XfceRcSimple *simple,
+            UndoOp op,
+            Group *group,
+            Entry *entry,
+            gpointer prev,
+            gchar *value)
+{
+  Undo undo;
+
+  if (G_LIKELY (simple->undo == NULL))
+    return;
+
+  undo.op = op;
+  undo.group = group;
+  undo.entry = entry;
+  undo.prev = prev;
+  undo.value = value;
+  g_array_append_val (simple->undo, undo);
+}
+
+
+
+static void
+simple_unlink_group (XfceRcSimple *simple,
+                     Group *group)
+{
+  if (group->prev != NULL)
+    group->prev->next = group->next;
+  else
+    simple->gfirst = group->next;
+  if (group->next != NULL)
+    group->next->prev = group->prev;
+  else
+    simple->glast = group->prev;
+
+  g_hash_table_remove (simple->groups, group->name);
+}
+
+
+
+/* inserts @group after @prev, or first if @prev is NULL */
+static void
+simple_link_group (XfceRcSimple *simple,
+                   Group *group,
+                   Group *prev)
+{
+  group->prev = prev;
+  group->next = (prev != NULL) ? prev->next : simple->gfirst;
+  if (prev != NULL)
+    prev->next = group;
+  else
+    simple->gfirst = group;
+  if (group->next != NULL)
+    group->next->prev = group;
+  else
+    simple->glast = group;
+
+  g_hash_table_insert (simple->groups, group->name, group);
+}
+
+
+
+static void
+simple_unlink_entry (Group *group,
+                     Entry *entry)
+{
+  if (entry->prev != NULL)
+    entry->prev->next = entry->next;
+  else
+    group->efirst = entry->next;
+  if (entry->next != NULL)
+    entry->next->prev = entry->prev;
+  else
+    group->elast = entry->prev;
+
+  g_hash_table_remove (group->entries, entry->key);
+}
+
+
+
+/* inserts @entry after @prev, or first if @prev is NULL */
+static void
+simple_link_entry (Group *group,
+                   Entry *entry,
+                   Entry *prev)
+{
+  entry->prev = prev;
+  entry->next = (prev != NULL) ? prev->next : group->efirst;
+  if (prev != NULL)
+    prev->next = entry;
+  else
+    group->efirst = entry;
+  if (entry->next != NULL)
+    entry->next->prev = entry;
+  else
+    group->elast = entry;
+
+  g_hash_table_insert (group->entries, entry->key, entry);
+}
+
+
+
+void
+_xfce_rc_simple_begin (XfceRc *rc)
+{
+  XfceRcSimple *simple = XFCE_RC_SIMPLE (rc);
+
+  /* transactions do not nest */
+  if (simple->undo != NULL)
+    return;
+
+  simple->undo = g_array_new (FALSE, FALSE, sizeof (Undo));
+  simple->undo_group = simple->group;
+  simple->undo_dirty = simple->dirty;
+}
+
+
+
+/* keeps the changes of the transaction and frees what it deleted */
+void
+_xfce_rc_simple_commit (XfceRc *rc)
+{
+  XfceRcSimple *simple = XFCE_RC_SIMPLE (rc);
+  Entry *entry;
+  Entry *next;
+  Undo *undo;
+  guint n;
+
+  if (simple->undo == NULL)
+    return;
+
+  for (n = 0; n < simple->undo->len; ++n)
+    {
+      undo = &g_array_index (simple->undo, Undo, n);
+      switch (undo->op)
+        {
+        case UNDO_GROUP_UNLINKED:
+          simple_group_free (simple, undo->group);
+          break;
+
+        case UNDO_GROUP_CLEARED:
+          for (entry = undo->entry; entry != NULL; entry = next)
+            {
+              next = entry->next;
+              simple_entry_free (simple, entry);
+            }
+          break;
+
+        case UNDO_ENTRY_UNLINKED:
+          simple_entry_free (simple, undo->entry);
+          break;
+
+        default:
+          break;
+        }
     }
+
+  g_array_free (simple->undo, TRUE);
+  simple->undo = NULL;
 }
 
 
@@ -752,8 +2456,69 @@ void
 _xfce_rc_simple_rollback (XfceRc *rc)
 {
   XfceRcSimple *simple = XFCE_RC_SIMPLE (rc);
+  Entry *entry;
+  Undo *undo;
+  guint n;
 
-  simple->dirty = FALSE;
+  if (simple->undo == NULL)
+    {
+      simple->dirty = FALSE;
+      return;
+    }
+
+  /* undo the changes in reverse order, so every change finds the
+   * contents exactly the way it left them */
+  for (n = simple->undo->len; n-- > 0;)
+    {
+      undo = &g_array_index (simple->undo, Undo, n);
+      switch (undo->op)
+        {
+        case UNDO_GROUP_ADDED:
+          simple_unlink_group (simple, undo->group);
+          simple_group_free (simple, undo->group);
+          break;
+
+        case UNDO_GROUP_UNLINKED:
+          simple_link_group (simple, undo->group, undo->prev);
+          break;
+
+        case UNDO_GROUP_CLEARED:
+          undo->group->efirst = undo->entry;
+          undo->group->elast = undo->prev;
+          for (entry = undo->entry; entry != NULL; entry = entry->next)
+            g_hash_table_insert (undo->group->entries, entry->key, entry);
+          break;
+
+        case UNDO_ENTRY_ADDED:
+          simple_unlink_entry (undo->group, undo->entry);
+          simple_entry_free (simple, undo->entry);
+          break;
+
+        case UNDO_ENTRY_UNLINKED:
+          simple_link_entry (undo->group, undo->entry, undo->prev);
+          break;
+
+        case UNDO_VALUE_CHANGED:
+          simple->garbage += strlen (undo->entry->value) + 1;
+          simple->garbage -= strlen (undo->value) + 1;
+          undo->entry->value = undo->value;
+          break;
+        }
+    }
+
+  g_array_free (simple->undo, TRUE);
+  simple->undo = NULL;
+
+  simple->group = simple->undo_group;
+  simple->dirty = simple->undo_dirty;
+}
+
+
+
+gboolean
+_xfce_rc_simple_in_transaction (const XfceRc *rc)
+{
+  return XFCE_RC_SIMPLE_CONST (rc)->undo != NULL;
 }
 
 
@@ -823,7 +2588,7 @@ _xfce_rc_simple_get_entries (const XfceRc *rc,
                              const gchar *name)
 {
   const XfceRcSimple *simple = XFCE_RC_SIMPLE_CONST (rc);
-  const Group *group;
+  Group *group;
   const Entry *entry;
   gchar **result;
   guint size;
@@ -832,13 +2597,12 @@ _xfce_rc_simple_get_entries (const XfceRc *rc,
   if (name == NULL)
     name = NULL_GROUP;
 
-  for (group = simple->gfirst; group != NULL; group = group->next)
-    if (str_is_equal (group->name, name))
-      break;
-
+  group = g_hash_table_lookup (simple->groups, name);
   if (group == NULL)
     return NULL;
 
+  simple_load_group (XFCE_RC_SIMPLE (rc), group);
+
   result = g_new (gchar *, 11);
   size = 10;
   pos = 0;
@@ -874,40 +2638,44 @@ _xfce_rc_simple_delete_group (XfceRc *rc,
   if (name == NULL)
     name = NULL_GROUP;
 
-  for (group = simple->gfirst; group != NULL; group = group->next)
+  group = g_hash_table_lookup (simple->groups, name);
+  if (group == NULL)
+    return;
+
+  /* whatever was not parsed yet is deleted as well, unless
+   * the transaction may bring it back */
+  if (simple->undo != NULL)
+    simple_load_group (simple, group);
+  else
+    simple_drop_pending (simple, group);
+
+  if (simple->group == group || str_is_equal (name, NULL_GROUP))
     {
-      if (str_is_equal (group->name, name))
+      /* don't delete current group or the default group, just clear them */
+      if (simple->undo != NULL)
+        simple_log (simple, UNDO_GROUP_CLEARED, group, group->efirst, group->elast, NULL);
+      else
         {
-          if (simple->group == group || str_is_equal (name, NULL_GROUP))
-            {
-              /* don't delete current group or the default group, just clear them */
-              for (entry = group->efirst; entry != NULL; entry = next)
-                {
-                  next = entry->next;
-                  simple_entry_free (entry);
-                }
-              group->efirst = group->elast = NULL;
-            }
-          else
+          for (entry = group->efirst; entry != NULL; entry = next)
             {
-              /* unlink group from group list */
-              if (group->prev != NULL)
-                group->prev->next = group->next;
-              else
-                simple->gfirst = group->next;
-              if (group->next != NULL)
-                group->next->prev = group->prev;
-              else
-                simple->glast = group->prev;
-
-              /* delete this group */
-              simple_group_free (group);
+              next = entry->next;
+              simple_entry_free (simple, entry);
             }
-
-          simple->dirty = TRUE;
-          break;
         }
+      group->efirst = group->elast = NULL;
+      g_hash_table_remove_all (group->entries);
+    }
+  else
+    {
+      simple_log (simple, UNDO_GROUP_UNLINKED, group, NULL, group->prev, NULL);
+      simple_unlink_group (simple, group);
+
+      /* delete this group */
+      if (simple->undo == NULL)
+        simple_group_free (simple, group);
     }
+
+  simple->dirty = TRUE;
 }
 
 
@@ -930,17 +2698,12 @@ _xfce_rc_simple_has_group (const XfceRc *rc,
                            const gchar *name)
 {
   const XfceRcSimple *simple = XFCE_RC_SIMPLE_CONST (rc);
-  const Group *group;
 
   /* the NULL group always exists */
   if (name == NULL)
     return TRUE;
 
-  for (group = simple->gfirst; group != NULL; group = group->next)
-    if (str_is_equal (group->name, name))
-      break;
-
-  return group != NULL;
+  return g_hash_table_contains (simple->groups, name);
 }
 
 
@@ -950,12 +2713,20 @@ _xfce_rc_simple_set_group (XfceRc *rc,
                            const gchar *name)
 {
   XfceRcSimple *simple = XFCE_RC_SIMPLE (rc);
+  gboolean is_new;
 
   if (name == NULL)
     name = NULL_GROUP;
 
   if (!str_is_equal (simple->group->name, name))
-    simple->group = simple_add_group (simple, name);
+    {
+      is_new = simple->undo != NULL && !g_hash_table_contains (simple->groups, name);
+      simple->group = simple_add_group (simple, name);
+      if (is_new)
+        simple_log (simple, UNDO_GROUP_ADDED, simple->group, NULL, NULL, NULL);
+    }
+
+  simple_load_group (simple, simple->group);
 }
 
 
@@ -968,27 +2739,20 @@ _xfce_rc_simple_delete_entry (XfceRc *rc,
   XfceRcSimple *simple = XFCE_RC_SIMPLE (rc);
   Entry *entry;
 
-  for (entry = simple->group->efirst; entry != NULL; entry = entry->next)
-    {
-      if (str_is_equal (entry->key, key))
-        {
-          if (entry->prev != NULL)
-            entry->prev->next = entry->next;
-          else
-            simple->group->efirst = entry->next;
+  simple_load_group (simple, simple->group);
 
-          if (entry->next != NULL)
-            entry->next->prev = entry->prev;
-          else
-            simple->group->elast = entry->prev;
+  entry = g_hash_table_lookup (simple->group->entries, key);
+  if (entry == NULL)
+    return;
 
-          /* delete this entry */
-          simple_entry_free (entry);
+  simple_log (simple, UNDO_ENTRY_UNLINKED, simple->group, entry, entry->prev, NULL);
+  simple_unlink_entry (simple->group, entry);
 
-          simple->dirty = TRUE;
-          break;
-        }
-    }
+  /* delete this entry */
+  if (simple->undo == NULL)
+    simple_entry_free (simple, entry);
+
+  simple->dirty = TRUE;
 }
 
 
@@ -998,13 +2762,60 @@ _xfce_rc_simple_has_entry (const XfceRc *rc,
                            const gchar *key)
 {
   const XfceRcSimple *simple = XFCE_RC_SIMPLE_CONST (rc);
-  const Entry *entry;
 
-  for (entry = simple->group->efirst; entry != NULL; entry = entry->next)
-    if (str_is_equal (entry->key, key))
-      break;
+  /* loading the current group does not change what the caller sees */
+  simple_load_group (XFCE_RC_SIMPLE (rc), simple->group);
+
+  return g_hash_table_contains (simple->group->entries, key);
+}
+
+
+
+/* looks up the translation of @entry that fits the locale of @rc best */
+static LEntry *
+simple_match_lentry (const XfceRc *rc,
+                     const Entry *entry)
+{
+  gchar *locale_languages[] = { rc->locale, NULL };
+  LEntry *best_lentry;
+  LEntry *lentry;
+  guint best_match;
+  guint match;
+
+  for (gchar **p = (rc->languages != NULL) ? rc->languages : locale_languages;
+       *p != NULL; p++)
+    {
+      /* return untranslated value if we encounter the C locale */
+      if (g_strcmp0 (*p, "C") == 0)
+        break;
+
+      best_match = XFCE_LOCALE_NO_MATCH;
+      best_lentry = NULL;
+
+      for (lentry = entry->lfirst; lentry != NULL; lentry = lentry->next)
+        {
+          XFCE_RC_STATS_ADD (rc, lookup_steps, 1);
+
+          match = xfce_locale_match (*p, lentry->locale);
+          if (match == XFCE_LOCALE_FULL_MATCH)
+            {
+              /* FULL MATCH */
+              return lentry;
+            }
+          else if (match > best_match)
+            {
+              best_match = match;
+              best_lentry = lentry;
+            }
+        }
+
+      if (best_lentry != NULL)
+        return best_lentry;
+
+      /* FALL-THROUGH */
+    }
 
-  return entry != NULL;
+  return NULL;
 }
 
 
@@ -1015,57 +2826,411 @@ _xfce_rc_simple_read_entry (const XfceRc *rc,
                             gboolean translated)
 {
   const XfceRcSimple *simple = XFCE_RC_SIMPLE_CONST (rc);
-  LEntry *lentry;
   Entry *entry;
-  const gchar *best_value;
-  guint best_match;
-  guint match;
 
-  for (entry = simple->group->efirst; entry != NULL; entry = entry->next)
-    if (str_is_equal (entry->key, key))
-      break;
+  simple_load_group (XFCE_RC_SIMPLE (rc), simple->group);
+
+  entry = g_hash_table_lookup (simple->group->entries, key);
+  if (G_UNLIKELY (entry == NULL))
+    return NULL;
+
+  return simple_entry_value (rc, entry, translated);
+}
+
+
+
+/* like read_entry, but looks at the group @name instead of the current one */
+const gchar *
+_xfce_rc_simple_lookup (const XfceRc *rc,
+                        const gchar *name,
+                        const gchar *key,
+                        gboolean translated)
+{
+  const XfceRcSimple *simple = XFCE_RC_SIMPLE_CONST (rc);
+  Entry *entry;
+  Group *group;
+
+  group = g_hash_table_lookup (simple->groups, name != NULL ? name : NULL_GROUP);
+  if (group == NULL)
+    return NULL;
 
+  simple_load_group (XFCE_RC_SIMPLE (rc), group);
+
+  entry = g_hash_table_lookup (group->entries, key);
   if (G_UNLIKELY (entry == NULL))
     return NULL;
 
+  return simple_entry_value (rc, entry, translated);
+}
+
+
+
+static const gchar *
+simple_entry_value (const XfceRc *rc,
+                    Entry *entry,
+                    gboolean translated)
+{
   /* check for localized entry (best fit!) */
-  if (G_LIKELY (translated && (rc->locale != NULL || rc->languages != NULL)))
+  if (G_LIKELY (translated && entry->lfirst != NULL && (rc->locale != NULL || rc->languages != NULL)))
     {
-      gchar *locale_languages[] = { rc->locale, NULL };
-
-      for (gchar **p = (rc->languages != NULL) ? rc->languages : locale_languages;
-           *p != NULL; p++)
+      /* the locale of a handle never changes, so the match only needs
+       * to be looked up again when a translation is added to the entry */
+      if (G_UNLIKELY (!entry->lresolved))
         {
-          /* return untranslated value if we encounter the C locale */
-          if (g_strcmp0 (*p, "C") == 0)
-            break;
+          entry->lbest = simple_match_lentry (rc, entry);
+          entry->lresolved = TRUE;
+        }
+
+      if (entry->lbest != NULL)
+        return entry->lbest->value;
+    }
+
+  return entry->value;
+}
 
-          best_match = XFCE_LOCALE_NO_MATCH;
-          best_value = NULL;
+
+
+gsize
+_xfce_rc_simple_get_garbage (const XfceRc *rc)
+{
+  const XfceRcSimple *simple = XFCE_RC_SIMPLE_CONST (rc);
+
+  return simple->garbage;
+}
+
+
+
+/* copies all strings of @rc into @chunk and returns the chunk they were in,
+ * if it was owned by @rc, from now on @chunk is owned by @rc if @owner */
+GStringChunk *
+_xfce_rc_simple_move_strings (XfceRc *rc,
+                              GStringChunk *chunk,
+                              gboolean owner)
+{
+  XfceRcSimple *simple = XFCE_RC_SIMPLE (rc);
+  GStringChunk *old_chunk;
+  LEntry *lentry;
+  Entry *entry;
+  Group *group;
+
+#define MOVE_STRING(string) (string) = g_string_chunk_insert (chunk, (string))
+
+  if (simple->filename != NULL)
+    MOVE_STRING (simple->filename);
+
+  for (group = simple->gfirst; group != NULL; group = group->next)
+    {
+      /* the indexes are keyed by the strings, so update them as well */
+      MOVE_STRING (group->name);
+      g_hash_table_replace (simple->groups, group->name, group);
+
+      for (entry = group->efirst; entry != NULL; entry = entry->next)
+        {
+          MOVE_STRING (entry->key);
+          MOVE_STRING (entry->value);
+          g_hash_table_replace (group->entries, entry->key, entry);
 
           for (lentry = entry->lfirst; lentry != NULL; lentry = lentry->next)
             {
-              match = xfce_locale_match (*p, lentry->locale);
-              if (match == XFCE_LOCALE_FULL_MATCH)
-                {
-                  /* FULL MATCH */
-                  return lentry->value;
-                }
-              else if (match > best_match)
-                {
-                  best_match = match;
-                  best_value = lentry->value;
-                }
+              MOVE_STRING (lentry->locale);
+              MOVE_STRING (lentry->value);
+            }
+        }
+    }
+
+#undef MOVE_STRING
+
+  /* nothing points into the compiled image anymore */
+  if (simple->image != NULL)
+    {
+      g_bytes_unref (simple->image);
+      simple->image = NULL;
+    }
+
+  old_chunk = simple->shared_chunks ? NULL : simple->string_chunk;
+
+  simple->string_chunk = chunk;
+  simple->shared_chunks = !owner;
+  simple->garbage = 0;
+
+  return old_chunk;
+}
+
+
+
+void
+_xfce_rc_simple_compact (XfceRc *rc)
+{
+  XfceRcSimple *simple = XFCE_RC_SIMPLE (rc);
+  GStringChunk *old_chunk;
+
+  /* standalone handles always own their chunk, and an open
+   * transaction still refers to the old strings */
+  if (simple->garbage == 0 || simple->shared_chunks || simple->undo != NULL)
+    return;
+
+  old_chunk = _xfce_rc_simple_move_strings (rc, g_string_chunk_new (4096), TRUE);
+  g_string_chunk_free (old_chunk);
+}
+
+
+
+GSList *
+_xfce_rc_simple_get_layers (XfceRc *rc)
+{
+  return g_slist_prepend (NULL, rc);
+}
+
+
+
+/* parses the file of @rc again into a new handle that borrows the string
+ * chunk of @rc, or returns NULL if @rc has changes that were not written
+ * or is in a transaction */
+XfceRc *
+_xfce_rc_simple_reparse (XfceRc *rc)
+{
+  XfceRcSimple *simple = XFCE_RC_SIMPLE (rc);
+  XfceRcSimple *fresh;
+
+  if (simple->dirty || simple->undo != NULL || simple->filename == NULL)
+    return NULL;
+
+  fresh = _xfce_rc_simple_new (simple, simple->filename, simple->readonly);
+
+  /* keep the same entries as before */
+  if (simple->keep_groups != NULL)
+    fresh->keep_groups = g_hash_table_ref (simple->keep_groups);
+  if (simple->keep_keys != NULL)
+    fresh->keep_keys = g_hash_table_ref (simple->keep_keys);
+  fresh->skip_group = simple->keep_groups != NULL;
+  fresh->shared_image = simple->shared_image;
+
+  /* a file that is gone has no entries anymore */
+  if (g_file_test (simple->filename, G_FILE_TEST_IS_REGULAR)
+      && !_xfce_rc_simple_parse (fresh))
+    {
+      xfce_rc_close (XFCE_RC (fresh));
+      return NULL;
+    }
+
+  return XFCE_RC (fresh);
+}
+
+
+
+/* appends the group and key of every entry that differs between @rc and
+ * @fresh to @changed, as pairs of newly allocated strings */
+void
+_xfce_rc_simple_diff (XfceRc *rc,
+                      XfceRc *fresh,
+                      GPtrArray *changed)
+{
+  XfceRcSimple *simple = XFCE_RC_SIMPLE (rc);
+  XfceRcSimple *other = XFCE_RC_SIMPLE (fresh);
+  const gchar *name;
+  Entry *other_entry;
+  Group *other_group;
+  Entry *entry;
+  Group *group;
+  guint pass;
+
+  simple_load_all (simple);
+
+  /* first the entries of @rc that changed or are gone, then
+   * the entries of @fresh that are new */
+  for (pass = 0; pass < 2; ++pass)
+    {
+      for (group = simple->gfirst; group != NULL; group = group->next)
+        {
+          other_group = g_hash_table_lookup (other->groups, group->name);
+          name = str_is_equal (group->name, NULL_GROUP) ? NULL : group->name;
+
+          for (entry = group->efirst; entry != NULL; entry = entry->next)
+            {
+              other_entry = (other_group != NULL) ? g_hash_table_lookup (other_group->entries, entry->key) : NULL;
+              if (other_entry != NULL
+                  && (pass == 1
+                      || (str_is_equal (entry->value, other_entry->value)
+                          && str_is_equal (simple_entry_value (XFCE_RC (simple), entry, TRUE),
+                                           simple_entry_value (XFCE_RC (other), other_entry, TRUE)))))
+                continue;
+
+              g_ptr_array_add (changed, g_strdup (name));
+              g_ptr_array_add (changed, g_strdup (entry->key));
             }
+        }
+
+      /* swap the roles for the second pass */
+      simple = XFCE_RC_SIMPLE (fresh);
+      other = XFCE_RC_SIMPLE (rc);
+    }
+}
 
-          if (best_value != NULL)
-            return best_value;
 
-          /* FALL-THROUGH */
+
+/* moves the contents of @fresh, created by _xfce_rc_simple_reparse(),
+ * into @rc and closes @fresh */
+void
+_xfce_rc_simple_replace (XfceRc *rc,
+                         XfceRc *fresh)
+{
+  XfceRcSimple *simple = XFCE_RC_SIMPLE (rc);
+  XfceRcSimple *other = XFCE_RC_SIMPLE (fresh);
+  const gchar *image_start = NULL;
+  const gchar *image_end = NULL;
+  LEntry *lentry;
+  gchar *current;
+  guint n;
+  gsize garbage;
+  Group *group;
+  Entry *entry;
+
+  current = g_strdup (simple->group->name);
+
+  if (simple->image != NULL)
+    {
+      image_start = g_bytes_get_data (simple->image, NULL);
+      image_end = image_start + g_bytes_get_size (simple->image);
+    }
+
+  /* the old contents are garbage in the chunk, which stays with @rc,
+   * unless they point into the image, which goes with @fresh */
+#define GARBAGE(string) \
+  (((string) >= image_start && (string) < image_end) ? 0 : strlen (string) + 1)
+
+  garbage = simple->garbage;
+  for (group = simple->gfirst; group != NULL; group = group->next)
+    {
+      garbage += GARBAGE (group->name);
+      for (entry = group->efirst; entry != NULL; entry = entry->next)
+        {
+          garbage += GARBAGE (entry->key) + GARBAGE (entry->value);
+          for (lentry = entry->lfirst; lentry != NULL; lentry = lentry->next)
+            garbage += GARBAGE (lentry->locale) + GARBAGE (lentry->value);
         }
     }
 
-  return entry->value;
+#undef GARBAGE
+
+  /* the nodes, and what they point into, change places; the string
+   * chunk, the file and the state of flushes and transactions stay */
+#define SWAP(type, field) \
+  G_STMT_START { \
+    type tmp = simple->field; \
+    simple->field = other->field; \
+    other->field = tmp; \
+  } G_STMT_END
+
+  SWAP (Group *, gfirst);
+  SWAP (Group *, glast);
+  SWAP (Group *, group);
+  SWAP (GHashTable *, groups);
+  SWAP (GBytes *, image);
+  SWAP (GBytes *, source);
+  SWAP (guint, n_pending);
+  SWAP (GPtrArray *, arena);
+  SWAP (gchar *, arena_pos);
+  SWAP (gsize, arena_left);
+  for (n = 0; n < G_N_ELEMENTS (simple->arena_free); ++n)
+    SWAP (gpointer, arena_free[n]);
+
+#undef SWAP
+
+  simple->garbage = garbage;
+
+  /* stay in the current group */
+  simple->group = simple_add_group (simple, current);
+  g_free (current);
+
+  xfce_rc_close (fresh);
+}
+
+
+
+/* like has_entry, but looks at the group @name instead of the current one */
+gboolean
+_xfce_rc_simple_has_group_entry (const XfceRc *rc,
+                                 const gchar *name,
+                                 const gchar *key)
+{
+  const XfceRcSimple *simple = XFCE_RC_SIMPLE_CONST (rc);
+  Group *group;
+
+  group = g_hash_table_lookup (simple->groups, name != NULL ? name : NULL_GROUP);
+  if (group == NULL)
+    return FALSE;
+
+  simple_load_group (XFCE_RC_SIMPLE (rc), group);
+
+  return g_hash_table_contains (group->entries, key);
+}
+
+
+
+/* returns the first group, or the first entry of the group @name */
+gconstpointer
+_xfce_rc_simple_iter_first (const XfceRc *rc,
+                            gboolean entries,
+                            const gchar *name)
+{
+  const XfceRcSimple *simple = XFCE_RC_SIMPLE_CONST (rc);
+  Group *group;
+
+  if (!entries)
+    return simple->gfirst;
+
+  group = g_hash_table_lookup (simple->groups, name != NULL ? name : NULL_GROUP);
+  if (group == NULL)
+    return NULL;
+
+  simple_load_group (XFCE_RC_SIMPLE (rc), group);
+
+  return group->efirst;
+}
+
+
+
+/* stores the name of @node in @name and returns the node after it */
+gconstpointer
+_xfce_rc_simple_iter_step (gconstpointer node,
+                           gboolean entries,
+                           const gchar **name)
+{
+  const Entry *entry;
+  const Group *group;
+
+  if (entries)
+    {
+      entry = node;
+      *name = entry->key;
+      return entry->next;
+    }
+
+  group = node;
+  *name = group->name;
+  return group->next;
+}
+
+
+
+void
+_xfce_rc_simple_iter_init (XfceRcRealIter *iter)
+{
+  iter->node = _xfce_rc_simple_iter_first (iter->rc, iter->entries, iter->group);
+}
+
+
+
+gboolean
+_xfce_rc_simple_iter_next (XfceRcRealIter *iter,
+                           const gchar **name)
+{
+  if (iter->node == NULL)
+    return FALSE;
+
+  iter->node = _xfce_rc_simple_iter_step (iter->node, iter->entries, name);
+
+  return TRUE;
 }
 
 
@@ -1077,10 +3242,28 @@ _xfce_rc_simple_write_entry (XfceRc *rc,
 {
   XfceRcSimple *simple = XFCE_RC_SIMPLE (rc);
   Entry *result;
+  Entry *entry = NULL;
+  gchar *old_value = NULL;
 
-  result = simple_add_entry (simple, key, value, NULL);
+  simple_load_group (simple, simple->group);
+
+  if (simple->undo != NULL)
+    {
+      entry = g_hash_table_lookup (simple->group->entries, key);
+      if (entry != NULL)
+        old_value = entry->value;
+    }
+
+  result = simple_add_entry (simple, key, value, -1, NULL);
   if (G_LIKELY (result != NULL))
-    simple->dirty = TRUE;
+    {
+      if (entry == NULL)
+        simple_log (simple, UNDO_ENTRY_ADDED, simple->group, result, NULL, NULL);
+      else if (result->value != old_value)
+        simple_log (simple, UNDO_VALUE_CHANGED, simple->group, result, NULL, old_value);
+
+      simple->dirty = TRUE;
+    }
 }
 
 
@@ -0,0 +1,240 @@
+/*-
+ * Copyright (c) 2026 The Xfce development team
+ * All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Immutable rc snapshots.
+ *
+ * A snapshot is a copy of the merged contents of an #XfceRc at one point in
+ * time, with the best translation of every entry already resolved. Nothing
+ * in it changes after it was built, so any number of threads may look up
+ * entries in it at the same time without taking a lock.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "xfce-private.h"
+#include "xfce-rc-private.h"
+#include "libxfce4util-visibility.h"
+
+
+
+typedef struct _SnapshotEntry SnapshotEntry;
+
+
+
+struct _XfceRcSnapshot
+{
+  gatomicrefcount ref_count;
+
+  /* all strings of the snapshot */
+  GStringChunk *strings;
+
+  /* group name -> GHashTable of key -> SnapshotEntry */
+  GHashTable *groups;
+};
+
+struct _SnapshotEntry
+{
+  const gchar *value;
+  const gchar *translated;
+};
+
+
+
+G_DEFINE_BOXED_TYPE (XfceRcSnapshot, xfce_rc_snapshot, xfce_rc_snapshot_ref, xfce_rc_snapshot_unref)
+
+
+
+static void
+snapshot_entry_free (gpointer data)
+{
+  g_slice_free (SnapshotEntry, data);
+}
+
+
+
+/* must be called by the thread that uses @rc */
+XfceRcSnapshot *
+_xfce_rc_snapshot_new (XfceRc *rc)
+{
+  XfceRcSnapshot *snapshot;
+  SnapshotEntry *entry;
+  GHashTable *entries;
+  XfceRcIter group_iter;
+  XfceRcIter entry_iter;
+  const gchar *group;
+  const gchar *key;
+
+  _xfce_return_val_if_fail (rc != NULL, NULL);
+  _xfce_return_val_if_fail (rc->lookup != NULL, NULL);
+
+  snapshot = g_slice_new (XfceRcSnapshot);
+  g_atomic_ref_count_init (&snapshot->ref_count);
+  snapshot->strings = g_string_chunk_new (4096);
+  snapshot->groups = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                                            (GDestroyNotify) g_hash_table_destroy);
+
+  /* the iterators and lookups leave the current group of @rc alone */
+  xfce_rc_iter_init_groups (&group_iter, rc);
+  while (xfce_rc_iter_next (&group_iter, &group))
+    {
+      entries = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, snapshot_entry_free);
+      g_hash_table_insert (snapshot->groups,
+                           g_string_chunk_insert_const (snapshot->strings, group),
+                           entries);
+
+      xfce_rc_iter_init_entries (&entry_iter, rc, group);
+      while (xfce_rc_iter_next (&entry_iter, &key))
+        {
+          entry = g_slice_new (SnapshotEntry);
+          entry->value = g_string_chunk_insert_const (snapshot->strings,
+                                                      (*rc->lookup) (rc, group, key, FALSE));
+          entry->translated = g_string_chunk_insert_const (snapshot->strings,
+                                                           (*rc->lookup) (rc, group, key, TRUE));
+          g_hash_table_insert (entries, g_string_chunk_insert_const (snapshot->strings, key), entry);
+        }
+    }
+
+  return snapshot;
+}
+
+
+
+/**
+ * xfce_rc_snapshot_ref:
+ * @snapshot : an #XfceRcSnapshot.
+ *
+ * Increases the reference count of @snapshot by one. This function is
+ * thread-safe.
+ *
+ * Return value: (transfer full): @snapshot.
+ *
+ * Since: 4.21.0
+ **/
+XfceRcSnapshot *
+xfce_rc_snapshot_ref (XfceRcSnapshot *snapshot)
+{
+  g_return_val_if_fail (snapshot != NULL, NULL);
+
+  g_atomic_ref_count_inc (&snapshot->ref_count);
+
+  return snapshot;
+}
+
+
+
+/**
+ * xfce_rc_snapshot_unref:
+ * @snapshot : an #XfceRcSnapshot.
+ *
+ * Decreases the reference count of @snapshot by one. When it drops to zero,
+ * @snapshot and all strings looked up in it are freed. This function is
+ * thread-safe.
+ *
+ * Since: 4.21.0
+ **/
+void
+xfce_rc_snapshot_unref (XfceRcSnapshot *snapshot)
+{
+  g_return_if_fail (snapshot != NULL);
+
+  if (g_atomic_ref_count_dec (&snapshot->ref_count))
+    {
+      g_hash_table_destroy (snapshot->groups);
+      g_string_chunk_free (snapshot->strings);
+      g_slice_free (XfceRcSnapshot, snapshot);
+    }
+}
+
+
+
+/**
+ * xfce_rc_snapshot_has_group:
+ * @snapshot : an #XfceRcSnapshot.
+ * @group    : (nullable): name of the group to check for.
+ *
+ * Checks whether the #XfceRc @snapshot was taken from had a group named
+ * @group. Like xfce_rc_has_group(), the %NULL group always exists.
+ *
+ * Return value: %TRUE if @snapshot contains @group, else %FALSE.
+ *
+ * Since: 4.21.0
+ **/
+gboolean
+xfce_rc_snapshot_has_group (const XfceRcSnapshot *snapshot,
+                            const gchar *group)
+{
+  g_return_val_if_fail (snapshot != NULL, FALSE);
+
+  if (group == NULL)
+    return TRUE;
+
+  return g_hash_table_contains (snapshot->groups, group);
+}
+
+
+
+/**
+ * xfce_rc_snapshot_lookup:
+ * @snapshot   : an #XfceRcSnapshot.
+ * @group      : (nullable): name of the group, or %NULL for the default group.
+ * @key        : the name of the entry.
+ * @translated : whether to return the best translation of the entry, like
+ *               xfce_rc_read_entry() does, or the untranslated value, like
+ *               xfce_rc_read_entry_untranslated() does.
+ *
+ * Looks up the value of @key in @group. Unlike xfce_rc_read_entry(), this
+ * does not depend on a current group, so it may be called from any number
+ * of threads at once.
+ *
+ * Return value: (nullable): the value of @key, or %NULL if @snapshot has no
+ *               such entry. It stays valid as long as @snapshot is alive.
+ *
+ * Since: 4.21.0
+ **/
+const gchar *
+xfce_rc_snapshot_lookup (const XfceRcSnapshot *snapshot,
+                         const gchar *group,
+                         const gchar *key,
+                         gboolean translated)
+{
+  const SnapshotEntry *entry;
+  GHashTable *entries;
+
+  g_return_val_if_fail (snapshot != NULL, NULL);
+  g_return_val_if_fail (key != NULL, NULL);
+
+  entries = g_hash_table_lookup (snapshot->groups, group != NULL ? group : NULL_GROUP);
+  if (entries == NULL)
+    return NULL;
+
+  entry = g_hash_table_lookup (entries, key);
+  if (entry == NULL)
+    return NULL;
+
+  return translated ? entry->translated : entry->value;
+}
+
+
+
+#define __XFCE_RC_SNAPSHOT_C__
+#include "libxfce4util-visibility.c"
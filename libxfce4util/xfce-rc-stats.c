@@ -0,0 +1,221 @@
+/*-
+ * Copyright (c) 2026 The Xfce development team
+ * All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Rc statistics.
+ *
+ * When XFCE4UTIL_STATS is set in the environment, every XfceRc gets a pair
+ * of XfceRcStats: the counters of the handle itself, and the part of them
+ * that was already added to the process-wide totals. The hot paths only
+ * test whether the handle has counters, so without the variable the
+ * statistics cost a predictable branch.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_MEMORY_H
+#include <memory.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include "xfce-private.h"
+#include "xfce-rc-private.h"
+#include "libxfce4util-visibility.h"
+
+
+
+#define STATS_ENVVAR "XFCE4UTIL_STATS"
+
+/* the number of counters in XfceRcStats */
+#define N_COUNTERS (G_STRUCT_OFFSET (XfceRcStats, padding) / sizeof (guint64))
+
+/* the counters of @rc that were not added to the totals yet */
+#define STATS_PUBLISHED(rc) (&(rc)->stats[1])
+
+
+
+G_LOCK_DEFINE_STATIC (global_stats);
+static XfceRcStats global_stats;
+
+
+
+/* adds @a - @b to @result */
+static void
+stats_add_delta (XfceRcStats *result,
+                 const XfceRcStats *a,
+                 const XfceRcStats *b)
+{
+  guint64 *r = (guint64 *) result;
+  const guint64 *x = (const guint64 *) a;
+  const guint64 *y = (const guint64 *) b;
+  gsize n;
+
+  for (n = 0; n < N_COUNTERS; ++n)
+    r[n] += x[n] - (y != NULL ? y[n] : 0);
+}
+
+
+
+gboolean
+_xfce_rc_stats_enabled (void)
+{
+  static gsize enabled = 0;
+  const gchar *value;
+
+  if (g_once_init_enter (&enabled))
+    {
+      value = g_getenv (STATS_ENVVAR);
+      g_once_init_leave (&enabled, (value != NULL && *value != '\0' && strcmp (value, "0") != 0) ? 2 : 1);
+    }
+
+  return enabled == 2;
+}
+
+
+
+void
+_xfce_rc_stats_init (XfceRc *rc)
+{
+  if (G_UNLIKELY (_xfce_rc_stats_enabled ()))
+    rc->stats = g_new0 (XfceRcStats, 2);
+}
+
+
+
+/* adds what @rc counted since the last call to the process-wide totals */
+void
+_xfce_rc_stats_publish (XfceRc *rc)
+{
+  if (rc->stats == NULL)
+    return;
+
+  G_LOCK (global_stats);
+  stats_add_delta (&global_stats, rc->stats, STATS_PUBLISHED (rc));
+  G_UNLOCK (global_stats);
+
+  *STATS_PUBLISHED (rc) = *rc->stats;
+}
+
+
+
+void
+_xfce_rc_stats_free (XfceRc *rc)
+{
+  if (rc->stats == NULL)
+    return;
+
+  _xfce_rc_stats_publish (rc);
+  g_free (rc->stats);
+  rc->stats = NULL;
+}
+
+
+
+/**
+ * xfce_rc_get_stats:
+ * @rc    : an #XfceRc object.
+ * @stats : (out caller-allocates): return location for the counters.
+ *
+ * Fills @stats with the counters of the work @rc did since it was opened.
+ * For handles returned by xfce_rc_config_open(), this is the sum over all
+ * files it consists of. Lookups are counted once, on the handle they were
+ * made on.
+ *
+ * The counters are only kept if the environment variable XFCE4UTIL_STATS
+ * is set to a value other than 0 when the first #XfceRc is opened, so
+ * they cost nothing otherwise.
+ *
+ * Return value: %TRUE if @stats was filled, %FALSE if statistics are
+ *               disabled, in which case @stats is all zeros.
+ *
+ * Since: 4.21.0
+ **/
+gboolean
+xfce_rc_get_stats (XfceRc *rc,
+                   XfceRcStats *stats)
+{
+  GSList *layers;
+  GSList *list;
+  XfceRc *layer;
+
+  g_return_val_if_fail (rc != NULL, FALSE);
+  g_return_val_if_fail (stats != NULL, FALSE);
+
+  memset (stats, 0, sizeof (*stats));
+
+  if (rc->stats == NULL)
+    return FALSE;
+
+  /* the files do the parsing, writing and translating */
+  layers = (*rc->get_layers) (rc);
+  for (list = layers; list != NULL; list = list->next)
+    {
+      layer = list->data;
+      if (layer->stats != NULL && layer != rc)
+        stats_add_delta (stats, layer->stats, NULL);
+    }
+  g_slist_free (layers);
+
+  stats_add_delta (stats, rc->stats, NULL);
+
+  return TRUE;
+}
+
+
+
+/**
+ * xfce_rc_get_global_stats:
+ * @stats : (out caller-allocates): return location for the counters.
+ *
+ * Fills @stats with the counters of all #XfceRc objects of the process, see
+ * xfce_rc_get_stats(). Handles that are still open are included up to their
+ * last parse or flush, closed handles completely.
+ *
+ * Return value: %TRUE if @stats was filled, %FALSE if statistics are
+ *               disabled, in which case @stats is all zeros.
+ *
+ * Since: 4.21.0
+ **/
+gboolean
+xfce_rc_get_global_stats (XfceRcStats *stats)
+{
+  g_return_val_if_fail (stats != NULL, FALSE);
+
+  if (!_xfce_rc_stats_enabled ())
+    {
+      memset (stats, 0, sizeof (*stats));
+      return FALSE;
+    }
+
+  G_LOCK (global_stats);
+  *stats = global_stats;
+  G_UNLOCK (global_stats);
+
+  return TRUE;
+}
+
+
+
+#define __XFCE_RC_STATS_C__
+#include "libxfce4util-visibility.c"
@@ -33,207 +33,1409 @@
  * reduced heap corruption). But due to this fact, an #XfceRc object might consume quite
  * a lot of memory after some time of usage. Therefore you should close an #XfceRc object
  * as soon as possible after loading configuration data from the object.
+ *
+ * If the environment variable XFCE4UTIL_RC_CACHE is set, the parsed contents of
+ * every file are also stored in a compiled form below the #XFCE_RESOURCE_CACHE
+ * directory. Subsequent opens of the same, unchanged file then map this image
+ * instead of parsing the file again.
+ *
+ * The compiled system files of xfce_rc_config_open() are stored below the
+ * directory returned by g_get_user_runtime_dir() instead, so the processes of
+ * a session share a single read-only mapping of them. Images are only used if
+ * they and their directory belong to the effective user and are not
+ * accessible by anyone else.
+ *
+ * Within a process, opening a file read-only again, e.g. the system files of
+ * xfce_rc_config_open(), reuses the compiled form of the first open as long
+ * as the file did not change, so the file is parsed only once.
+ *
+ * If the environment variable XFCE4UTIL_STATS is set, every #XfceRc counts
+ * the bytes it parses, the entries it creates and the lookups it serves, see
+ * xfce_rc_get_stats() and xfce_rc_get_global_stats().
  */
 
-#ifdef HAVE_CONFIG_H
-#include "config.h"
-#endif
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+#ifdef HAVE_LIMITS_H
+#include <limits.h>
+#endif
+#ifdef HAVE_LOCALE_H
+#include <locale.h>
+#endif
+#ifdef HAVE_MEMORY_H
+#include <memory.h>
+#endif
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "libxfce4util.h"
+#include "xfce-private.h"
+#include "xfce-rc-private.h"
+#include "libxfce4util-visibility.h"
+
+
+
+/* how much xfce_rc_simple_open_from_stream() reads at once */
+#define STREAM_BLOCK_SIZE 8192
+
+/* the state of one xfce_rc_simple_open_many() call */
+typedef struct _XfceRcBulkOpen XfceRcBulkOpen;
+
+/* one xfce_rc_flush_async() call */
+typedef struct _XfceRcFlush XfceRcFlush;
+
+struct _XfceRcBulkOpen
+{
+  const gchar *const *filenames;
+  XfceRc **rcs;
+  gint n_files;
+  gboolean readonly;
+
+  /* the index of the next file to open */
+  gint next;
+
+  /* the number of pool tasks that did not finish yet */
+  GMutex lock;
+  GCond cond;
+  guint n_running;
+};
+
+struct _XfceRcFlush
+{
+  /* the handle the job was taken from, NULL once it was closed */
+  XfceRc *rc;
+  guint serial;
+
+  GAsyncReadyCallback callback;
+  gpointer user_data;
+};
+
+/* protects the snapshot pointer of every XfceRc */
+G_LOCK_DEFINE_STATIC (snapshot_lock);
+
+
+
+typedef struct _XfceRcWatchLayer XfceRcWatchLayer;
+
+struct _XfceRcWatch
+{
+  XfceRcChangedFunc func;
+  gpointer user_data;
+  GDestroyNotify destroy_notify;
+  GSList *layers;
+};
+
+struct _XfceRcWatchLayer
+{
+  XfceRc *rc;
+  XfceRc *layer;
+  GFileMonitor *monitor;
+
+  /* the file changed while a flush or a transaction of @rc was pending */
+  guint deferred : 1;
+};
+
+
+
+static void
+xfce_rc_publish_snapshot (XfceRc *rc);
+static void
+xfce_rc_watch_resume (XfceRc *rc);
+static void
+xfce_rc_cancel_auto_flush (XfceRc *rc);
+
+
+
+static XfceRc *
+xfce_rc_copy (const XfceRc *rc)
+{
+  return g_slice_dup (XfceRc, rc);
+}
+
+static void
+xfce_rc_free (XfceRc *rc)
+{
+  if (G_LIKELY (rc != NULL))
+    {
+      g_slice_free (XfceRc, rc);
+    }
+}
+
+G_DEFINE_BOXED_TYPE (XfceRc, xfce_rc, xfce_rc_copy, xfce_rc_free)
+
+/* called by _xfce_rc_{simple,config}_new */
+void
+_xfce_rc_init (XfceRc *rc)
+{
+#ifdef HAVE_SETLOCALE
+  const gchar *language;
+  gchar *locale;
+#endif
+
+  _xfce_return_if_fail (rc != NULL);
+
+  _xfce_rc_stats_init (rc);
+
+#ifdef HAVE_SETLOCALE
+  language = g_getenv ("LANGUAGE");
+  if (language != NULL)
+    rc->languages = g_strsplit (language, ":", -1);
+
+  locale = setlocale (LC_MESSAGES, NULL);
+  if (locale != NULL
+      && strcmp (locale, "C") != 0
+      && strcmp (locale, "POSIX") != 0)
+    {
+      rc->locale = g_strdup (locale);
+    }
+#endif
+}
+
+
+
+/**
+ * xfce_rc_simple_open:
+ * @filename : name of the filename to open.
+ * @readonly : whether to open @filename readonly.
+ *
+ * Parses the resource config file specified by @filename.
+ *
+ * If @readonly is %TRUE parsing is generally faster, because only untranslated
+ * entries and entries that match the current locale will be loaded. Also if
+ * you pass %TRUE for @readonly, #xfce_rc_simple_open will fail if @filename
+ * does not reference a regular file.
+ *
+ * It is no error if @readonly is %FALSE and the file referenced by @filename
+ * does not exists. In this case you'll start with a fresh config, which contains
+ * only the default group and no entries.
+ *
+ * Return value: (transfer full): the newly created #XfceRc object, or %NULL on error.
+ *
+ * Since: 4.2
+ **/
+XfceRc *
+xfce_rc_simple_open (const gchar *filename,
+                     gboolean readonly)
+{
+  XfceRcSimple *simple;
+  gboolean exists;
+
+  exists = g_file_test (filename, G_FILE_TEST_IS_REGULAR);
+
+  if (!exists && readonly)
+    return NULL;
+
+  simple = _xfce_rc_simple_new (NULL, filename, readonly);
+
+  if (exists && !_xfce_rc_simple_parse (simple))
+    {
+      xfce_rc_close (XFCE_RC (simple));
+      return NULL;
+    }
+
+  return XFCE_RC (simple);
+}
+
+
+
+/**
+ * xfce_rc_simple_open_lazy:
+ * @filename : name of the filename to open.
+ * @readonly : whether to open @filename readonly.
+ *
+ * Same as xfce_rc_simple_open(), but only looks for the group headers in
+ * @filename when opening it. The entries of a group are parsed the first
+ * time the group is used, e.g. by xfce_rc_set_group(), xfce_rc_get_entries()
+ * or xfce_rc_has_entry(), so opening a large file to read a few keys does not
+ * cost more than reading those keys.
+ *
+ * The contents of the file are kept in memory until all groups were parsed
+ * or the #XfceRc is closed, so later changes to the file do not affect the
+ * groups that were not parsed yet. The compiled images enabled by
+ * XFCE4UTIL_RC_CACHE are not used for lazy opens.
+ *
+ * Return value: (transfer full): the newly created #XfceRc object, or %NULL on error.
+ *
+ * Since: 4.21.0
+ **/
+XfceRc *
+xfce_rc_simple_open_lazy (const gchar *filename,
+                          gboolean readonly)
+{
+  XfceRcSimple *simple;
+  gboolean exists;
+
+  exists = g_file_test (filename, G_FILE_TEST_IS_REGULAR);
+
+  if (!exists && readonly)
+    return NULL;
+
+  simple = _xfce_rc_simple_new (NULL, filename, readonly);
+
+  if (exists && !_xfce_rc_simple_parse_lazy (simple))
+    {
+      xfce_rc_close (XFCE_RC (simple));
+      return NULL;
+    }
+
+  return XFCE_RC (simple);
+}
+
+
+
+/**
+ * xfce_rc_simple_open_projected:
+ * @filename : name of the filename to open.
+ * @groups   : (array zero-terminated=1) (nullable): the groups to keep, or %NULL.
+ * @keys     : (array zero-terminated=1) (nullable): the keys to keep, or %NULL.
+ *
+ * Same as xfce_rc_simple_open() with @readonly set to %TRUE, but only keeps
+ * the entries whose group is listed in @groups and whose key is listed in
+ * @keys. The other entries are skipped while parsing, without copying their
+ * keys or values, so opening a file with hundreds of entries to read a
+ * handful of them is about as cheap as if the file only had those entries.
+ *
+ * If @groups is %NULL, the listed keys of all groups are kept, if @keys is
+ * %NULL, all keys of the listed groups are kept. Entries outside of any
+ * group are only kept if @groups is %NULL. Translations of a kept key are
+ * loaded the same way as for xfce_rc_simple_open(). The compiled images
+ * enabled by XFCE4UTIL_RC_CACHE are not used for projected opens.
+ *
+ * Return value: (transfer full): the newly created #XfceRc object, or %NULL on error.
+ *
+ * Since: 4.21.0
+ **/
+XfceRc *
+xfce_rc_simple_open_projected (const gchar *filename,
+                               const gchar *const *groups,
+                               const gchar *const *keys)
+{
+  XfceRcSimple *simple;
+
+  g_return_val_if_fail (filename != NULL, NULL);
+
+  if (!g_file_test (filename, G_FILE_TEST_IS_REGULAR))
+    return NULL;
+
+  simple = _xfce_rc_simple_new (NULL, filename, TRUE);
+  _xfce_rc_simple_set_projection (simple, groups, keys);
+
+  if (!_xfce_rc_simple_parse (simple))
+    {
+      xfce_rc_close (XFCE_RC (simple));
+      return NULL;
+    }
+
+  return XFCE_RC (simple);
+}
+
+
+
+/**
+ * xfce_rc_simple_open_from_bytes:
+ * @bytes : the contents of an rc file.
+ *
+ * Same as xfce_rc_simple_open() with @readonly set to %TRUE, but parses
+ * @bytes instead of a file, e.g. a config from a #GResource or a D-Bus
+ * message. The groups, keys and values are copied into the returned
+ * #XfceRc while @bytes is parsed, so @bytes is not referenced after this
+ * function returns.
+ *
+ * The returned #XfceRc is read-only and has no file behind it, so
+ * xfce_rc_watch() does nothing for it.
+ *
+ * Return value: (transfer full): the newly created #XfceRc object.
+ *
+ * Since: 4.21.0
+ **/
+XfceRc *
+xfce_rc_simple_open_from_bytes (GBytes *bytes)
+{
+  XfceRcSimple *simple;
+  gconstpointer data;
+  gsize length;
+
+  g_return_val_if_fail (bytes != NULL, NULL);
+
+  simple = _xfce_rc_simple_new (NULL, NULL, TRUE);
+
+  data = g_bytes_get_data (bytes, &length);
+  _xfce_rc_simple_parse_data (simple, data, length);
+
+  return XFCE_RC (simple);
+}
+
+
+
+/**
+ * xfce_rc_simple_open_from_stream:
+ * @stream      : a #GInputStream with the contents of an rc file.
+ * @cancellable : (nullable): a #GCancellable, or %NULL.
+ * @error       : return location for a #GError, or %NULL.
+ *
+ * Same as xfce_rc_simple_open_from_bytes(), but reads the contents from
+ * @stream, e.g. a #GConverterInputStream that decompresses an archive.
+ * @stream is parsed while it is read, so only the line that is being read
+ * is buffered, not the whole contents. @stream is not closed.
+ *
+ * Return value: (transfer full): the newly created #XfceRc object, or %NULL
+ *               if reading @stream failed.
+ *
+ * Since: 4.21.0
+ **/
+XfceRc *
+xfce_rc_simple_open_from_stream (GInputStream *stream,
+                                 GCancellable *cancellable,
+                                 GError **error)
+{
+  XfceRcSimple *simple;
+  GByteArray *buffer;
+  gsize length;
+  gsize lines;
+  gssize n;
+
+  g_return_val_if_fail (G_IS_INPUT_STREAM (stream), NULL);
+  g_return_val_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable), NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  simple = _xfce_rc_simple_new (NULL, NULL, TRUE);
+  buffer = g_byte_array_sized_new (2 * STREAM_BLOCK_SIZE);
+
+  for (;;)
+    {
+      length = buffer->len;
+      g_byte_array_set_size (buffer, length + STREAM_BLOCK_SIZE);
+
+      n = g_input_stream_read (stream, buffer->data + length, STREAM_BLOCK_SIZE, cancellable, error);
+      if (n < 0)
+        {
+          g_byte_array_unref (buffer);
+          xfce_rc_close (XFCE_RC (simple));
+          return NULL;
+        }
+
+      g_byte_array_set_size (buffer, length + n);
+      if (n == 0)
+        break;
+
+      /* parse all complete lines, and keep the last one for the next read;
+       * the bytes kept from before hold no newline, so only the new ones
+       * need to be scanned */
+      for (lines = buffer->len; lines > length && buffer->data[lines - 1] != '\n'; --lines)
+        ;
+      if (lines > length)
+        {
+          _xfce_rc_simple_parse_data (simple, (const gchar *) buffer->data, lines);
+          g_byte_array_remove_range (buffer, 0, lines);
+        }
+    }
+
+  /* the last line may not end with a newline */
+  _xfce_rc_simple_parse_data (simple, (const gchar *) buffer->data, buffer->len);
+  g_byte_array_unref (buffer);
+
+  return XFCE_RC (simple);
+}
+
+
+
+/* opens files of @bulk until none are left */
+static void
+xfce_rc_bulk_open_run (XfceRcBulkOpen *bulk)
+{
+  gint n;
+
+  /* every thread takes the next file as soon as it is done with one,
+   * so a few large files do not hold up the others */
+  for (;;)
+    {
+      n = g_atomic_int_add (&bulk->next, 1);
+      if (n >= bulk->n_files)
+        break;
+
+      bulk->rcs[n] = xfce_rc_simple_open (bulk->filenames[n], bulk->readonly);
+    }
+}
+
+
+
+static void
+xfce_rc_bulk_open_thread (gpointer data,
+                          gpointer user_data)
+{
+  XfceRcBulkOpen *bulk = data;
+
+  xfce_rc_bulk_open_run (bulk);
+
+  g_mutex_lock (&bulk->lock);
+  if (--bulk->n_running == 0)
+    g_cond_signal (&bulk->cond);
+  g_mutex_unlock (&bulk->lock);
+}
+
+
+
+static GThreadPool *
+xfce_rc_get_open_pool (void)
+{
+  static gsize pool = 0;
+
+  if (g_once_init_enter (&pool))
+    {
+      g_once_init_leave (&pool, (gsize) g_thread_pool_new (xfce_rc_bulk_open_thread, NULL,
+                                                           g_get_num_processors (), FALSE, NULL));
+    }
+
+  return (GThreadPool *) pool;
+}
+
+
+
+static void
+xfce_rc_close_nullable (gpointer rc)
+{
+  if (rc != NULL)
+    xfce_rc_close (rc);
+}
+
+
+
+/**
+ * xfce_rc_simple_open_many:
+ * @filenames : (array zero-terminated=1): the files to open.
+ * @readonly  : whether to open the files readonly.
+ *
+ * Opens all @filenames like xfce_rc_simple_open() does, on as many threads
+ * as there are processors, e.g. to read all `.desktop` files of the
+ * `applications` directories at once.
+ *
+ * The handles are independent of each other and may be used and closed
+ * separately. Like all #XfceRc objects, each of them may only be used by
+ * one thread at a time.
+ *
+ * Return value: (transfer full) (element-type XfceRc): an array with the
+ *               #XfceRc of each file, in the order of @filenames, with %NULL
+ *               for files that could not be opened. Freeing the array closes
+ *               all handles that are still in it.
+ *
+ * Since: 4.21.0
+ **/
+GPtrArray *
+xfce_rc_simple_open_many (const gchar *const *filenames,
+                          gboolean readonly)
+{
+  XfceRcBulkOpen bulk;
+  GPtrArray *result;
+  GThreadPool *pool;
+  guint n_tasks;
+  guint n;
+
+  g_return_val_if_fail (filenames != NULL, NULL);
+
+  bulk.filenames = filenames;
+  bulk.n_files = g_strv_length ((gchar **) filenames);
+  bulk.readonly = readonly;
+  bulk.next = 0;
+
+  result = g_ptr_array_new_full (bulk.n_files, xfce_rc_close_nullable);
+  g_ptr_array_set_size (result, bulk.n_files);
+  bulk.rcs = (XfceRc **) result->pdata;
+
+  if (bulk.n_files == 0)
+    return result;
+
+  /* the resource directories are set up on first use, which is not
+   * thread-safe, and the compiled images are stored below them */
+  if (_xfce_rc_cache_enabled ())
+    g_free (xfce_resource_save_location (XFCE_RESOURCE_CACHE, NULL, FALSE));
+
+  pool = xfce_rc_get_open_pool ();
+  n_tasks = MIN ((guint) bulk.n_files, g_get_num_processors ()) - 1;
+
+  g_mutex_init (&bulk.lock);
+  g_cond_init (&bulk.cond);
+  bulk.n_running = n_tasks;
+
+  for (n = 0; n < n_tasks; ++n)
+    g_thread_pool_push (pool, &bulk, NULL);
+
+  /* this thread helps as well */
+  xfce_rc_bulk_open_run (&bulk);
+
+  g_mutex_lock (&bulk.lock);
+  while (bulk.n_running > 0)
+    g_cond_wait (&bulk.cond, &bulk.lock);
+  g_mutex_unlock (&bulk.lock);
+
+  g_mutex_clear (&bulk.lock);
+  g_cond_clear (&bulk.cond);
+
+  return result;
+}
+
+
+
+/**
+ * xfce_rc_config_open:
+ * @type     : The resource type being opened
+ * @resource : The resource name to open
+ * @readonly : whether to open @resource readonly.
+ *
+ * If @readonly is %TRUE parsing is generally faster, because only untranslated
+ * entries and entries that match the current locale will be loaded. Also if
+ * you pass %TRUE for @readonly, #xfce_rc_config will fail if @resource
+ * does not reference a regular file.
+ *
+ * It is no error if @readonly is %FALSE and the file referenced by @resource
+ * does not exists. In this case you'll start with a fresh config, which contains
+ * only the default group and no entries.
+ *
+ * Return value: (transfer full): the newly created #XfceRc object, or %NULL on error.
+ *
+ * Since: 4.2
+ **/
+XfceRc *
+xfce_rc_config_open (XfceResourceType type,
+                     const gchar *resource,
+                     gboolean readonly)
+{
+  XfceRcConfig *config;
+
+  config = _xfce_rc_config_new (type, resource, readonly);
+
+  return XFCE_RC (config);
+}
+
+
+
+/**
+ * xfce_rc_parse_file:
+ * @filename  : name of the file to parse.
+ * @parser    : the #XfceRcParser with the callbacks to invoke.
+ * @user_data : (closure): data to pass to the callbacks.
+ * @error     : return location for a #GError, or %NULL.
+ *
+ * Reads @filename and calls the callbacks of @parser for the groups and
+ * entries in it, with the same syntax and escaping rules as
+ * xfce_rc_simple_open(), but without building an #XfceRc. This is meant for
+ * tools that scan many files for a few keys: the file is read in one piece,
+ * and no string is copied unless a callback does so.
+ *
+ * Unlike read-only #XfceRc objects, all translated entries are reported,
+ * whatever the current locale.
+ *
+ * Return value: %TRUE if the whole file was parsed, %FALSE if a callback
+ *               stopped the parser or the file could not be read, in which
+ *               case @error is set.
+ *
+ * Since: 4.21.0
+ **/
+gboolean
+xfce_rc_parse_file (const gchar *filename,
+                    const XfceRcParser *parser,
+                    gpointer user_data,
+                    GError **error)
+{
+  gchar *contents;
+  gsize length;
+  gboolean result;
+
+  g_return_val_if_fail (filename != NULL, FALSE);
+  g_return_val_if_fail (parser != NULL, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  if (!g_file_get_contents (filename, &contents, &length, error))
+    return FALSE;
+
+  result = _xfce_rc_simple_parse_events (contents, contents + length, parser, user_data);
+  g_free (contents);
+
+  return result;
+}
+
+
+
+/**
+ * xfce_rc_parse_data:
+ * @data      : the contents of an rc file.
+ * @length    : the length of @data in bytes, or -1 if it is nul-terminated.
+ * @parser    : the #XfceRcParser with the callbacks to invoke.
+ * @user_data : (closure): data to pass to the callbacks.
+ *
+ * Same as xfce_rc_parse_file(), but parses @data instead of a file.
+ *
+ * Return value: %TRUE if all of @data was parsed, %FALSE if a callback
+ *               stopped the parser.
+ *
+ * Since: 4.21.0
+ **/
+gboolean
+xfce_rc_parse_data (const gchar *data,
+                    gssize length,
+                    const XfceRcParser *parser,
+                    gpointer user_data)
+{
+  g_return_val_if_fail (data != NULL || length == 0, FALSE);
+  g_return_val_if_fail (parser != NULL, FALSE);
+
+  if (length < 0)
+    length = strlen (data);
+
+  return _xfce_rc_simple_parse_events (data, data + length, parser, user_data);
+}
+
+
+
+/**
+ * xfce_rc_close:
+ * @rc : an #XfceRc object.
+ *
+ * Destructs @rc.
+ *
+ * If @rc was opened read-write and contains dirty (modified) entries, these
+ * will be flushed to permanent storage first.
+ *
+ * Since: 4.2
+ **/
+void
+xfce_rc_close (XfceRc *rc)
+{
+  GSList *list;
+
+  g_return_if_fail (rc != NULL);
+  g_return_if_fail (rc->close != NULL);
+
+  xfce_rc_cancel_auto_flush (rc);
+  if (rc->auto_flush_context != NULL)
+    g_main_context_unref (rc->auto_flush_context);
+
+  /* the jobs still write the file, but can no longer give back the changes */
+  for (list = rc->pending_flushes; list != NULL; list = list->next)
+    ((XfceRcFlush *) list->data)->rc = NULL;
+  g_slist_free (rc->pending_flushes);
+
+  xfce_rc_unwatch (rc);
+
+  if (rc->flush != NULL)
+    (*rc->flush) (rc);
+
+  (*rc->close) (rc);
+
+  _xfce_rc_stats_free (rc);
+
+  if (rc->snapshot != NULL)
+    xfce_rc_snapshot_unref (rc->snapshot);
+
+  g_free (rc->locale);
+  g_strfreev (rc->languages);
+  g_free (rc);
+}
+
+
+
+/* replaces the published snapshot of @rc with one of its current contents */
+static void
+xfce_rc_publish_snapshot (XfceRc *rc)
+{
+  XfceRcSnapshot *snapshot;
+  XfceRcSnapshot *old_snapshot;
+
+  snapshot = _xfce_rc_snapshot_new (rc);
+
+  G_LOCK (snapshot_lock);
+  old_snapshot = rc->snapshot;
+  rc->snapshot = snapshot;
+  G_UNLOCK (snapshot_lock);
+
+  /* readers that still hold the old snapshot keep it alive */
+  if (old_snapshot != NULL)
+    xfce_rc_snapshot_unref (old_snapshot);
+}
+
+
+
+/**
+ * xfce_rc_get_snapshot:
+ * @rc : an #XfceRc object.
+ *
+ * Returns an immutable copy of the contents of @rc, as seen through the
+ * group, entry and translation lookup rules of @rc. The snapshot can be
+ * read from any number of threads at once with xfce_rc_snapshot_lookup(),
+ * without a lock and without touching the current group of @rc.
+ *
+ * The first call builds the snapshot and has to happen in the thread that
+ * uses @rc. Later calls, from any thread, return the latest published
+ * snapshot. A new snapshot is published every time xfce_rc_flush() or
+ * xfce_rc_flush_async() writes changes of @rc, so threads that need to see
+ * them call this function again; snapshots they still hold remain valid
+ * until they are unreferenced, even after @rc was closed.
+ *
+ * Return value: (transfer full): the latest snapshot of @rc, to be released
+ *               with xfce_rc_snapshot_unref().
+ *
+ * Since: 4.21.0
+ **/
+XfceRcSnapshot *
+xfce_rc_get_snapshot (XfceRc *rc)
+{
+  XfceRcSnapshot *snapshot = NULL;
+
+  g_return_val_if_fail (rc != NULL, NULL);
+
+  G_LOCK (snapshot_lock);
+  if (rc->snapshot != NULL)
+    snapshot = xfce_rc_snapshot_ref (rc->snapshot);
+  G_UNLOCK (snapshot_lock);
+
+  if (snapshot == NULL)
+    {
+      xfce_rc_publish_snapshot (rc);
+      snapshot = xfce_rc_snapshot_ref (rc->snapshot);
+    }
+
+  return snapshot;
+}
+
+
+
+/**
+ * xfce_rc_flush:
+ * @rc : an #XfceRc object.
+ *
+ * Flushes all changes that currently reside only in memory back to permanent
+ * storage. Dirty configuration entries are written in the most specific file
+ * available.
+ *
+ * The file is replaced atomically, so readers see either the old or the new
+ * contents. If the new contents are the same as the ones the file had when
+ * it was last loaded or written, and it did not change since, the file is
+ * left alone.
+ *
+ * Since: 4.2
+ **/
+void
+xfce_rc_flush (XfceRc *rc)
+{
+  gboolean publish;
+
+  g_return_if_fail (rc != NULL);
+
+  publish = rc->snapshot != NULL && xfce_rc_is_dirty (rc);
+
+  if (rc->flush != NULL)
+    (*rc->flush) (rc);
+
+  if (publish)
+    xfce_rc_publish_snapshot (rc);
+}
+
+
+
+static void
+xfce_rc_flush_ready (GObject *source_object,
+                     GAsyncResult *result,
+                     gpointer user_data)
+{
+  XfceRcFlush *flush = user_data;
+  XfceRc *rc = flush->rc;
+
+  if (rc != NULL)
+    {
+      rc->pending_flushes = g_slist_remove (rc->pending_flushes, flush);
+
+      /* the changes are still only in memory */
+      if (g_task_had_error (G_TASK (result)))
+        (*rc->save_failed) (rc, flush->serial);
+
+      if (rc->pending_flushes == NULL && rc->watch != NULL)
+        xfce_rc_watch_resume (rc);
+    }
+
+  if (flush->callback != NULL)
+    (*flush->callback) (source_object, result, flush->user_data);
+
+  g_slice_free (XfceRcFlush, flush);
+}
+
+
+
+static void
+xfce_rc_flush_thread (gpointer data,
+                      gpointer user_data)
+{
+  GTask *task = G_TASK (data);
+  XfceRcSaveJob *job;
+  GError *error = NULL;
+
+  job = g_task_get_task_data (task);
+
+  if (!g_task_return_error_if_cancelled (task))
+    {
+      if (_xfce_rc_save_job_run (job, NULL, &error))
+        g_task_return_boolean (task, TRUE);
+      else
+        g_task_return_error (task, error);
+    }
+
+  g_object_unref (task);
+}
+
+
+
+static GThreadPool *
+xfce_rc_get_flush_pool (void)
+{
+  static gsize pool = 0;
+
+  /* a single worker, so jobs are written in the order they were taken */
+  if (g_once_init_enter (&pool))
+    g_once_init_leave (&pool, (gsize) g_thread_pool_new (xfce_rc_flush_thread, NULL, 1, FALSE, NULL));
+
+  return (GThreadPool *) pool;
+}
+
+
+
+/**
+ * xfce_rc_flush_async:
+ * @rc          : an #XfceRc object.
+ * @cancellable : (nullable): a #GCancellable, or %NULL.
+ * @callback    : (scope async) (nullable): a #GAsyncReadyCallback to call when the
+ *                file was written, or %NULL.
+ * @user_data   : (closure): data to pass to @callback.
+ *
+ * Asynchronous version of xfce_rc_flush(). The dirty entries of @rc are
+ * serialized right away, so @rc is clean when this function returns and may
+ * be changed or closed at will, while the file is written on a worker
+ * thread. @callback is called in the thread-default main context of the
+ * calling thread, and the #GAsyncResult passed to it has no source object.
+ *
+ * If the file could not be written, or @cancellable was cancelled before,
+ * @rc is marked dirty again right before @callback is called, unless it was
+ * flushed again meanwhile, so the changes are written by the next flush or
+ * by xfce_rc_close(). If @rc was closed before, only @callback learns that
+ * the changes were lost.
+ *
+ * Since: 4.21.0
+ **/
+void
+xfce_rc_flush_async (XfceRc *rc,
+                     GCancellable *cancellable,
+                     GAsyncReadyCallback callback,
+                     gpointer user_data)
+{
+  XfceRcSaveJob *job = NULL;
+  XfceRcFlush *flush;
+  GTask *task;
+
+  g_return_if_fail (rc != NULL);
+  g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+
+  flush = g_slice_new0 (XfceRcFlush);
+  flush->callback = callback;
+  flush->user_data = user_data;
+
+  task = g_task_new (NULL, cancellable, xfce_rc_flush_ready, flush);
+  g_task_set_source_tag (task, xfce_rc_flush_async);
+
+  /* the result tells whether the file was written, even if the
+   * cancellable was cancelled afterwards */
+  g_task_set_check_cancellable (task, FALSE);
+
+  /* this flush takes care of a pending auto flush */
+  xfce_rc_cancel_auto_flush (rc);
+
+  if (rc->save_job != NULL)
+    job = (*rc->save_job) (rc);
+
+  if (job == NULL)
+    {
+      /* nothing to write */
+      g_task_return_boolean (task, TRUE);
+      g_object_unref (task);
+      return;
+    }
+
+  flush->rc = rc;
+  flush->serial = job->serial;
+  rc->pending_flushes = g_slist_prepend (rc->pending_flushes, flush);
+
+  g_task_set_task_data (task, job, (GDestroyNotify) _xfce_rc_save_job_free);
+  g_thread_pool_push (xfce_rc_get_flush_pool (), task, NULL);
+
+  if (rc->snapshot != NULL)
+    xfce_rc_publish_snapshot (rc);
+}
+
+
+
+/**
+ * xfce_rc_flush_finish:
+ * @rc     : the #XfceRc object passed to xfce_rc_flush_async().
+ * @result : the #GAsyncResult passed to the callback.
+ * @error  : return location for a #GError, or %NULL.
+ *
+ * Finishes an operation started with xfce_rc_flush_async(). @rc is only
+ * used for sanity checks and may have been closed in the meantime.
+ *
+ * Return value: %TRUE if the file was written, %FALSE with @error set otherwise.
+ *
+ * Since: 4.21.0
+ **/
+gboolean
+xfce_rc_flush_finish (XfceRc *rc,
+                      GAsyncResult *result,
+                      GError **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, NULL), FALSE);
+  g_return_val_if_fail (g_task_get_source_tag (G_TASK (result)) == xfce_rc_flush_async, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+
+
+static void
+xfce_rc_auto_flush_ready (GObject *source_object,
+                          GAsyncResult *result,
+                          gpointer user_data)
+{
+  GError *error = NULL;
+
+  /* @rc is dirty again, so the next change schedules another try */
+  if (!g_task_propagate_boolean (G_TASK (result), &error))
+    {
+      g_warning ("%s", error->message);
+      g_error_free (error);
+    }
+}
+
+
+
+static gboolean
+xfce_rc_auto_flush_timeout (gpointer user_data)
+{
+  XfceRc *rc = user_data;
+
+  g_source_unref (rc->auto_flush_source);
+  rc->auto_flush_source = NULL;
+  xfce_rc_flush_async (rc, NULL, xfce_rc_auto_flush_ready, NULL);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+
+static void
+xfce_rc_cancel_auto_flush (XfceRc *rc)
+{
+  if (rc->auto_flush_source != NULL)
+    {
+      g_source_destroy (rc->auto_flush_source);
+      g_source_unref (rc->auto_flush_source);
+      rc->auto_flush_source = NULL;
+    }
+}
+
+
+
+/* called after every change to @rc */
+static void
+xfce_rc_schedule_auto_flush (XfceRc *rc)
+{
+  if (rc->auto_flush_interval > 0
+      && rc->auto_flush_source == NULL
+      && xfce_rc_is_dirty (rc))
+    {
+      rc->auto_flush_source = g_timeout_source_new (rc->auto_flush_interval);
+      g_source_set_callback (rc->auto_flush_source, xfce_rc_auto_flush_timeout, rc, NULL);
+      g_source_attach (rc->auto_flush_source, rc->auto_flush_context);
+    }
+}
+
+
+
+/**
+ * xfce_rc_set_auto_flush:
+ * @rc       : an #XfceRc object.
+ * @interval : the time in milliseconds to collect changes, or 0.
+ *
+ * Makes @rc flush itself in the background, using xfce_rc_flush_async(),
+ * @interval milliseconds after the first change that made it dirty. All
+ * changes made within that window end up in a single write, which keeps the
+ * number of writes low when an entry changes many times per second, e.g.
+ * while a slider is dragged. The timeout is added to the thread-default
+ * main context of the thread that called this function, so the flushes
+ * happen while that context is iterated.
+ *
+ * Passing 0 disables auto flushing, which is the default. Any changes left
+ * are still written by xfce_rc_flush() or xfce_rc_close().
+ *
+ * Since: 4.21.0
+ **/
+void
+xfce_rc_set_auto_flush (XfceRc *rc,
+                        guint interval)
+{
+  g_return_if_fail (rc != NULL);
+
+  rc->auto_flush_interval = interval;
 
-#ifdef HAVE_ERRNO_H
-#include <errno.h>
-#endif
-#ifdef HAVE_LIMITS_H
-#include <limits.h>
-#endif
-#ifdef HAVE_LOCALE_H
-#include <locale.h>
-#endif
-#ifdef HAVE_MEMORY_H
-#include <memory.h>
-#endif
-#ifdef HAVE_STDLIB_H
-#include <stdlib.h>
-#endif
-#ifdef HAVE_STRING_H
-#include <string.h>
-#endif
+  xfce_rc_cancel_auto_flush (rc);
 
-#include "libxfce4util.h"
-#include "xfce-private.h"
-#include "xfce-rc-private.h"
-#include "libxfce4util-visibility.h"
+  if (rc->auto_flush_context != NULL)
+    g_main_context_unref (rc->auto_flush_context);
+  rc->auto_flush_context = g_main_context_ref_thread_default ();
 
+  xfce_rc_schedule_auto_flush (rc);
+}
 
 
-static XfceRc *
-xfce_rc_copy (const XfceRc *rc)
+
+/* parses @layer of @rc again and reports the entries that look different
+ * through @rc now, i.e. changes hidden by a more important layer are not */
+static void
+xfce_rc_reload_layer (XfceRc *rc,
+                      XfceRc *layer)
 {
-  return g_slice_dup (XfceRc, rc);
+  XfceRcChangedFunc func = rc->watch->func;
+  gpointer user_data = rc->watch->user_data;
+  GPtrArray *changed;
+  GPtrArray *values;
+  const gchar *group;
+  const gchar *key;
+  XfceRc *fresh;
+  guint n;
+
+  /* nothing to do if the change is our own flush */
+  if (_xfce_rc_simple_is_saved (layer))
+    return;
+
+  fresh = _xfce_rc_simple_reparse (layer);
+  if (fresh == NULL)
+    return;
+
+  changed = g_ptr_array_new_with_free_func (g_free);
+  _xfce_rc_simple_diff (layer, fresh, changed);
+  if (changed->len == 0)
+    {
+      xfce_rc_close (fresh);
+      g_ptr_array_unref (changed);
+      return;
+    }
+
+  values = g_ptr_array_new_with_free_func (g_free);
+  for (n = 0; n < changed->len; n += 2)
+    {
+      group = g_ptr_array_index (changed, n);
+      key = g_ptr_array_index (changed, n + 1);
+      g_ptr_array_add (values, g_strdup ((*rc->lookup) (rc, group, key, FALSE)));
+      g_ptr_array_add (values, g_strdup ((*rc->lookup) (rc, group, key, TRUE)));
+    }
+
+  _xfce_rc_simple_replace (layer, fresh);
+  if (rc->layer_replaced != NULL)
+    (*rc->layer_replaced) (rc);
+
+  if (rc->snapshot != NULL)
+    xfce_rc_publish_snapshot (rc);
+
+  for (n = 0; n < changed->len; n += 2)
+    {
+      group = g_ptr_array_index (changed, n);
+      key = g_ptr_array_index (changed, n + 1);
+      if (g_strcmp0 (g_ptr_array_index (values, n), (*rc->lookup) (rc, group, key, FALSE)) != 0
+          || g_strcmp0 (g_ptr_array_index (values, n + 1), (*rc->lookup) (rc, group, key, TRUE)) != 0)
+        {
+          (*func) (rc, group, key, user_data);
+        }
+    }
+
+  g_ptr_array_unref (values);
+  g_ptr_array_unref (changed);
 }
 
+
+
 static void
-xfce_rc_free (XfceRc *rc)
+xfce_rc_watch_changed (GFileMonitor *monitor,
+                       GFile *file,
+                       GFile *other_file,
+                       GFileMonitorEvent event_type,
+                       gpointer user_data)
 {
-  if (G_LIKELY (rc != NULL))
+  XfceRcWatchLayer *watch_layer = user_data;
+
+  /* xfce_rc_flush() replaces the file, which is reported as created */
+  if (event_type != G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT
+      && event_type != G_FILE_MONITOR_EVENT_CREATED
+      && event_type != G_FILE_MONITOR_EVENT_DELETED)
+    return;
+
+  /* the file may not have the contents of the handle yet, which is not
+   * dirty anymore, so wait until the pending flushes are done; an open
+   * transaction still refers to the old contents, so wait for its end */
+  if ((watch_layer->rc->pending_flushes != NULL
+       && !_xfce_rc_simple_is_readonly (watch_layer->layer))
+      || _xfce_rc_simple_in_transaction (watch_layer->layer))
     {
-      g_slice_free (XfceRc, rc);
+      watch_layer->deferred = TRUE;
+      return;
     }
+
+  xfce_rc_reload_layer (watch_layer->rc, watch_layer->layer);
 }
 
-G_DEFINE_BOXED_TYPE (XfceRc, xfce_rc, xfce_rc_copy, xfce_rc_free)
 
-/* called by _xfce_rc_{simple,config}_new */
+
+/* reloads the files that changed while flushes or a transaction of
+ * @rc were pending */
+static void
+xfce_rc_watch_resume (XfceRc *rc)
+{
+  XfceRcWatchLayer *watch_layer;
+  GSList *list;
+
+  for (list = rc->watch->layers; list != NULL; list = list->next)
+    {
+      watch_layer = list->data;
+      if (watch_layer->deferred
+          && !_xfce_rc_simple_in_transaction (watch_layer->layer))
+        {
+          watch_layer->deferred = FALSE;
+          xfce_rc_reload_layer (rc, watch_layer->layer);
+        }
+    }
+}
+
+
+
+/**
+ * XfceRcChangedFunc:
+ * @rc        : the #XfceRc that changed.
+ * @group     : (nullable): the group of the entry that changed, %NULL for
+ *              the default group.
+ * @key       : the name of the entry that changed.
+ * @user_data : the user data passed to xfce_rc_watch().
+ *
+ * The type of the function called by a watched #XfceRc for every entry
+ * whose value was changed, added or removed by another process.
+ *
+ * Since: 4.21.0
+ **/
+
+/**
+ * xfce_rc_watch:
+ * @rc             : an #XfceRc object.
+ * @func           : (scope notified): the function to call for changed entries.
+ * @user_data      : (closure): data to pass to @func.
+ * @destroy_notify : (nullable): function to free @user_data when the watch is
+ *                   removed, or %NULL.
+ *
+ * Monitors the files @rc was read from. When one of them changes on disk,
+ * only that file is parsed again and @func is called for every entry that
+ * looks different through @rc afterwards. A change to a system file that is
+ * hidden by the user file does not call @func. Files that did not exist
+ * when @rc was opened are not picked up, except for the user file.
+ *
+ * Files with changes that were not flushed yet are not reloaded, the
+ * changes in memory win until they are written. The same holds while
+ * xfce_rc_flush_async() writes them, the file is reloaded afterwards if it
+ * was changed by someone else, and during a transaction, which is followed
+ * by the reload when it is committed or rolled back. Strings returned by @rc
+ * for entries of a reloaded file may be invalid after a reload, as are
+ * iterators.
+ *
+ * The notifications are delivered in the thread-default main context of
+ * the thread that called this function. @func must not close @rc. Calling
+ * this function again replaces the previous watch.
+ *
+ * Since: 4.21.0
+ **/
 void
-_xfce_rc_init (XfceRc *rc)
+xfce_rc_watch (XfceRc *rc,
+               XfceRcChangedFunc func,
+               gpointer user_data,
+               GDestroyNotify destroy_notify)
 {
-#ifdef HAVE_SETLOCALE
-  const gchar *language;
-  gchar *locale;
-#endif
+  XfceRcWatchLayer *watch_layer;
+  GFileMonitor *monitor;
+  GSList *layers;
+  GSList *list;
+  GFile *file;
 
-  _xfce_return_if_fail (rc != NULL);
+  g_return_if_fail (rc != NULL);
+  g_return_if_fail (func != NULL);
 
-#ifdef HAVE_SETLOCALE
-  language = g_getenv ("LANGUAGE");
-  if (language != NULL)
-    rc->languages = g_strsplit (language, ":", -1);
+  xfce_rc_unwatch (rc);
 
-  locale = setlocale (LC_MESSAGES, NULL);
-  if (locale != NULL
-      && strcmp (locale, "C") != 0
-      && strcmp (locale, "POSIX") != 0)
+  rc->watch = g_slice_new0 (XfceRcWatch);
+  rc->watch->func = func;
+  rc->watch->user_data = user_data;
+  rc->watch->destroy_notify = destroy_notify;
+
+  layers = (*rc->get_layers) (rc);
+  for (list = layers; list != NULL; list = list->next)
     {
-      rc->locale = g_strdup (locale);
+      /* nothing to watch for handles parsed from memory */
+      if (_xfce_rc_simple_get_filename (list->data) == NULL)
+        continue;
+
+      file = g_file_new_for_path (_xfce_rc_simple_get_filename (list->data));
+      monitor = g_file_monitor_file (file, G_FILE_MONITOR_NONE, NULL, NULL);
+      g_object_unref (file);
+
+      if (monitor == NULL)
+        continue;
+
+      watch_layer = g_slice_new0 (XfceRcWatchLayer);
+      watch_layer->rc = rc;
+      watch_layer->layer = list->data;
+      watch_layer->monitor = monitor;
+      g_signal_connect (monitor, "changed", G_CALLBACK (xfce_rc_watch_changed), watch_layer);
+
+      rc->watch->layers = g_slist_prepend (rc->watch->layers, watch_layer);
     }
-#endif
+  g_slist_free (layers);
 }
 
 
 
 /**
- * xfce_rc_simple_open:
- * @filename : name of the filename to open.
- * @readonly : whether to open @filename readonly.
- *
- * Parses the resource config file specified by @filename.
- *
- * If @readonly is %TRUE parsing is generally faster, because only untranslated
- * entries and entries that match the current locale will be loaded. Also if
- * you pass %TRUE for @readonly, #xfce_rc_simple_open will fail if @filename
- * does not reference a regular file.
- *
- * It is no error if @readonly is %FALSE and the file referenced by @filename
- * does not exists. In this case you'll start with a fresh config, which contains
- * only the default group and no entries.
+ * xfce_rc_unwatch:
+ * @rc : an #XfceRc object.
  *
- * Return value: (transfer full): the newly created #XfceRc object, or %NULL on error.
+ * Stops monitoring the files of @rc, see xfce_rc_watch(). Does nothing
+ * if @rc is not watched.
  *
- * Since: 4.2
+ * Since: 4.21.0
  **/
-XfceRc *
-xfce_rc_simple_open (const gchar *filename,
-                     gboolean readonly)
+void
+xfce_rc_unwatch (XfceRc *rc)
 {
-  XfceRcSimple *simple;
-  gboolean exists;
+  XfceRcWatchLayer *watch_layer;
+  XfceRcWatch *watch;
+  GSList *list;
 
-  exists = g_file_test (filename, G_FILE_TEST_IS_REGULAR);
+  g_return_if_fail (rc != NULL);
 
-  if (!exists && readonly)
-    return NULL;
+  watch = rc->watch;
+  if (watch == NULL)
+    return;
 
-  simple = _xfce_rc_simple_new (NULL, filename, readonly);
+  rc->watch = NULL;
 
-  if (exists && !_xfce_rc_simple_parse (simple))
+  for (list = watch->layers; list != NULL; list = list->next)
     {
-      xfce_rc_close (XFCE_RC (simple));
-      return NULL;
+      watch_layer = list->data;
+      g_signal_handlers_disconnect_by_data (watch_layer->monitor, watch_layer);
+      g_file_monitor_cancel (watch_layer->monitor);
+      g_object_unref (watch_layer->monitor);
+      g_slice_free (XfceRcWatchLayer, watch_layer);
     }
+  g_slist_free (watch->layers);
 
-  return XFCE_RC (simple);
+  if (watch->destroy_notify != NULL)
+    (*watch->destroy_notify) (watch->user_data);
+
+  g_slice_free (XfceRcWatch, watch);
 }
 
 
 
 /**
- * xfce_rc_config_open:
- * @type     : The resource type being opened
- * @resource : The resource name to open
- * @readonly : whether to open @resource readonly.
- *
- * If @readonly is %TRUE parsing is generally faster, because only untranslated
- * entries and entries that match the current locale will be loaded. Also if
- * you pass %TRUE for @readonly, #xfce_rc_config will fail if @resource
- * does not reference a regular file.
+ * xfce_rc_compact:
+ * @rc : an #XfceRc object.
  *
- * It is no error if @readonly is %FALSE and the file referenced by @resource
- * does not exists. In this case you'll start with a fresh config, which contains
- * only the default group and no entries.
+ * Releases the memory held by values that were overwritten or deleted since
+ * @rc was opened or last compacted. #XfceRc never frees a string before it is
+ * closed, so that the strings returned by e.g. xfce_rc_read_entry() stay
+ * valid, which lets a long-living #XfceRc that is written to over and over
+ * grow without bounds. Calling this function every now and then, e.g. after
+ * xfce_rc_flush(), keeps its memory use proportional to its contents.
  *
- * Return value: (transfer full): the newly created #XfceRc object, or %NULL on error.
+ * All strings previously returned by @rc, including those from
+ * xfce_rc_iter_next(), are invalid after this call. If nothing was
+ * overwritten or deleted, this function does nothing.
  *
- * Since: 4.2
+ * Since: 4.21.0
  **/
-XfceRc *
-xfce_rc_config_open (XfceResourceType type,
-                     const gchar *resource,
-                     gboolean readonly)
+void
+xfce_rc_compact (XfceRc *rc)
 {
-  XfceRcConfig *config;
-
-  config = _xfce_rc_config_new (type, resource, readonly);
+  g_return_if_fail (rc != NULL);
 
-  return XFCE_RC (config);
+  if (rc->compact != NULL)
+    (*rc->compact) (rc);
 }
 
 
 
 /**
- * xfce_rc_close:
+ * xfce_rc_begin:
  * @rc : an #XfceRc object.
  *
- * Destructs @rc.
+ * Starts a transaction on @rc. From now on, @rc remembers how to undo every
+ * change made by xfce_rc_write_entry(), xfce_rc_delete_entry(),
+ * xfce_rc_delete_group() and xfce_rc_set_group(), until the transaction is
+ * ended by xfce_rc_commit() or xfce_rc_rollback(). Rolling back takes time
+ * proportional to the number of changes, not to the size of @rc, and does
+ * not touch the disk, so e.g. a settings dialog may apply changes right away
+ * and still revert all of them when the user cancels it.
  *
- * If @rc was opened read-write and contains dirty (modified) entries, these
- * will be flushed to permanent storage first.
+ * Transactions do not nest, calling this function while a transaction is
+ * open does nothing. xfce_rc_compact() does nothing while a transaction is
+ * open, and xfce_rc_watch() reloads the files changed meanwhile only once it
+ * ends. Closing @rc commits an open transaction.
  *
- * Since: 4.2
+ * Since: 4.21.0
  **/
 void
-xfce_rc_close (XfceRc *rc)
+xfce_rc_begin (XfceRc *rc)
 {
   g_return_if_fail (rc != NULL);
-  g_return_if_fail (rc->close != NULL);
-
-  if (rc->flush != NULL)
-    (*rc->flush) (rc);
-
-  (*rc->close) (rc);
 
-  g_free (rc->locale);
-  g_strfreev (rc->languages);
-  g_free (rc);
+  if (rc->begin != NULL)
+    (*rc->begin) (rc);
 }
 
 
 
 /**
- * xfce_rc_flush:
+ * xfce_rc_commit:
  * @rc : an #XfceRc object.
  *
- * Flushes all changes that currently reside only in memory back to permanent
- * storage. Dirty configuration entries are written in the most specific file
- * available.
+ * Ends the transaction started by xfce_rc_begin() and keeps all changes made
+ * since. This does not write anything, the changes are written by the next
+ * xfce_rc_flush() like any other. If no transaction is open, this function
+ * does nothing.
  *
- * Since: 4.2
+ * Since: 4.21.0
  **/
 void
-xfce_rc_flush (XfceRc *rc)
+xfce_rc_commit (XfceRc *rc)
 {
   g_return_if_fail (rc != NULL);
 
-  if (rc->flush != NULL)
-    (*rc->flush) (rc);
+  if (rc->commit != NULL)
+    (*rc->commit) (rc);
+
+  /* reload the files that changed during the transaction */
+  if (rc->pending_flushes == NULL && rc->watch != NULL)
+    xfce_rc_watch_resume (rc);
 }
 
 
@@ -242,9 +1444,15 @@ xfce_rc_flush (XfceRc *rc)
  * xfce_rc_rollback:
  * @rc : an #XfceRc object.
  *
- * Mark @rc as "clean", i.e. don't write dirty entries at destruction time. If
- * you then call #xfce_rc_write_entry again, the dirty flag is set again and
- * dirty entries will be written at a subsequent #xfce_rc_flush call.
+ * If a transaction was started by xfce_rc_begin(), undoes all changes made
+ * to @rc since, returns to the group that was current back then and ends the
+ * transaction. If @rc was flushed meanwhile, it is dirty afterwards, so the
+ * next xfce_rc_flush() writes the old contents again.
+ *
+ * Otherwise, mark @rc as "clean", i.e. don't write dirty entries at
+ * destruction time. If you then call #xfce_rc_write_entry again, the dirty
+ * flag is set again and dirty entries will be written at a subsequent
+ * #xfce_rc_flush call.
  *
  * Since: 4.2
  **/
@@ -255,6 +1463,53 @@ xfce_rc_rollback (XfceRc *rc)
 
   if (rc->rollback != NULL)
     (*rc->rollback) (rc);
+
+  /* reload the files that changed during the transaction */
+  if (rc->pending_flushes == NULL && rc->watch != NULL)
+    xfce_rc_watch_resume (rc);
+}
+
+
+
+/**
+ * xfce_rc_set_sync_mode:
+ * @rc   : an #XfceRc object.
+ * @mode : the new #XfceRcSyncMode.
+ *
+ * Sets how hard subsequent calls to xfce_rc_flush() try to get the written
+ * file onto permanent storage. Syncing makes flushing a lot slower, so the
+ * default is #XFCE_RC_SYNC_NONE, which is what #XfceRc always did.
+ *
+ * Since: 4.21.0
+ **/
+void
+xfce_rc_set_sync_mode (XfceRc *rc,
+                       XfceRcSyncMode mode)
+{
+  g_return_if_fail (rc != NULL);
+  g_return_if_fail (mode <= XFCE_RC_SYNC_FULL);
+
+  rc->sync_mode = mode;
+}
+
+
+
+/**
+ * xfce_rc_get_sync_mode:
+ * @rc : an #XfceRc object.
+ *
+ * Returns the #XfceRcSyncMode set with xfce_rc_set_sync_mode().
+ *
+ * Return value: the sync mode used by xfce_rc_flush().
+ *
+ * Since: 4.21.0
+ **/
+XfceRcSyncMode
+xfce_rc_get_sync_mode (const XfceRc *rc)
+{
+  g_return_val_if_fail (rc != NULL, XFCE_RC_SYNC_NONE);
+
+  return rc->sync_mode;
 }
 
 
@@ -408,7 +1663,10 @@ xfce_rc_delete_group (XfceRc *rc, const gchar *group, gboolean global)
   g_return_if_fail (rc != NULL);
 
   if (rc->delete_group != NULL)
-    (*rc->delete_group) (rc, group, global);
+    {
+      (*rc->delete_group) (rc, group, global);
+      xfce_rc_schedule_auto_flush (rc);
+    }
 }
 
 
@@ -501,7 +1759,10 @@ xfce_rc_delete_entry (XfceRc *rc, const gchar *key, gboolean global)
   g_return_if_fail (key != NULL);
 
   if (rc->delete_entry != NULL)
-    (*rc->delete_entry) (rc, key, global);
+    {
+      (*rc->delete_entry) (rc, key, global);
+      xfce_rc_schedule_auto_flush (rc);
+    }
 }
 
 
@@ -524,6 +1785,8 @@ xfce_rc_has_entry (const XfceRc *rc,
   g_return_val_if_fail (rc != NULL, FALSE);
   g_return_val_if_fail (key != NULL, FALSE);
 
+  XFCE_RC_STATS_ADD (rc, lookups, 1);
+
   if (G_LIKELY (rc->has_entry != NULL))
     return (*rc->has_entry) (rc, key);
   else
@@ -555,6 +1818,8 @@ xfce_rc_read_entry (const XfceRc *rc,
   g_return_val_if_fail (rc->read_entry != NULL, fallback);
   g_return_val_if_fail (key != NULL, fallback);
 
+  XFCE_RC_STATS_ADD (rc, lookups, 1);
+
   value = (*rc->read_entry) (rc, key, TRUE);
   if (value == NULL)
     value = fallback;
@@ -588,6 +1853,8 @@ xfce_rc_read_entry_untranslated (const XfceRc *rc,
   g_return_val_if_fail (rc->read_entry != NULL, fallback);
   g_return_val_if_fail (key != NULL, fallback);
 
+  XFCE_RC_STATS_ADD (rc, lookups, 1);
+
   value = (*rc->read_entry) (rc, key, FALSE);
   if (value == NULL)
     value = fallback;
@@ -733,7 +2000,10 @@ xfce_rc_write_entry (XfceRc *rc,
   g_return_if_fail (value != NULL);
 
   if (rc->write_entry != NULL)
-    (*rc->write_entry) (rc, key, value);
+    {
+      (*rc->write_entry) (rc, key, value);
+      xfce_rc_schedule_auto_flush (rc);
+    }
 }
 
 
@@ -815,5 +2085,114 @@ xfce_rc_write_list_entry (XfceRc *rc,
 
 
 
+G_STATIC_ASSERT (sizeof (XfceRcRealIter) <= sizeof (XfceRcIter));
+
+
+
+/**
+ * xfce_rc_iter_init_groups:
+ * @iter : an uninitialized #XfceRcIter.
+ * @rc   : an #XfceRc object.
+ *
+ * Initializes @iter to walk the groups of @rc, in the order returned by
+ * xfce_rc_get_groups(). Groups found in more than one file of a config
+ * opened with xfce_rc_config_open() are returned once.
+ *
+ * |[<!-- language="C" -->
+ * XfceRcIter iter;
+ * const gchar *group;
+ *
+ * xfce_rc_iter_init_groups (&iter, rc);
+ * while (xfce_rc_iter_next (&iter, &group))
+ *   {
+ *     // do something with group
+ *   }
+ * ]|
+ *
+ * Groups must not be added to or deleted from @rc while @iter is in use.
+ *
+ * Since: 4.21.0
+ **/
+void
+xfce_rc_iter_init_groups (XfceRcIter *iter,
+                          const XfceRc *rc)
+{
+  XfceRcRealIter *real_iter = (XfceRcRealIter *) iter;
+
+  g_return_if_fail (iter != NULL);
+  g_return_if_fail (rc != NULL);
+
+  real_iter->rc = rc;
+  real_iter->layer = NULL;
+  real_iter->group = NULL;
+  real_iter->entries = FALSE;
+
+  (*rc->iter_init) (real_iter);
+}
+
+
+
+/**
+ * xfce_rc_iter_init_entries:
+ * @iter  : an uninitialized #XfceRcIter.
+ * @rc    : an #XfceRc object.
+ * @group : (nullable): the name of the group whose keys should be walked.
+ *
+ * Initializes @iter to walk the keys of @group in @rc, in the order
+ * returned by xfce_rc_get_entries(). Unlike xfce_rc_set_group(), this does
+ * not change the current group of @rc, so the entries can be read with
+ * xfce_rc_read_entry() after switching to @group once.
+ *
+ * @group must stay valid while @iter is in use, and entries must not be
+ * deleted from it.
+ *
+ * Since: 4.21.0
+ **/
+void
+xfce_rc_iter_init_entries (XfceRcIter *iter,
+                           const XfceRc *rc,
+                           const gchar *group)
+{
+  XfceRcRealIter *real_iter = (XfceRcRealIter *) iter;
+
+  g_return_if_fail (iter != NULL);
+  g_return_if_fail (rc != NULL);
+
+  real_iter->rc = rc;
+  real_iter->layer = NULL;
+  real_iter->group = group;
+  real_iter->entries = TRUE;
+
+  (*rc->iter_init) (real_iter);
+}
+
+
+
+/**
+ * xfce_rc_iter_next:
+ * @iter : an #XfceRcIter.
+ * @name : (out) (transfer none): return location for the next group or key name.
+ *
+ * Advances @iter and stores the name of the next group or key in @name.
+ * The name is owned by the #XfceRc and must not be modified or freed.
+ *
+ * Return value: %FALSE if the end was reached.
+ *
+ * Since: 4.21.0
+ **/
+gboolean
+xfce_rc_iter_next (XfceRcIter *iter,
+                   const gchar **name)
+{
+  XfceRcRealIter *real_iter = (XfceRcRealIter *) iter;
+
+  g_return_val_if_fail (iter != NULL, FALSE);
+  g_return_val_if_fail (name != NULL, FALSE);
+
+  return (*real_iter->rc->iter_next) (real_iter, name);
+}
+
+
+
 #define __XFCE_RC_C__
 #include "libxfce4util-visibility.c"
@@ -26,36 +26,228 @@
 #ifndef __XFCE_RC_H__
 #define __XFCE_RC_H__
 
+#include <gio/gio.h>
 #include <glib-object.h>
 #include <libxfce4util/xfce-resource.h>
 
 G_BEGIN_DECLS
 
 typedef struct _XfceRc XfceRc;
+typedef struct _XfceRcIter XfceRcIter;
+typedef struct _XfceRcSnapshot XfceRcSnapshot;
+typedef struct _XfceRcParser XfceRcParser;
+typedef struct _XfceRcStats XfceRcStats;
+
+typedef void (*XfceRcChangedFunc) (XfceRc *rc,
+                                   const gchar *group,
+                                   const gchar *key,
+                                   gpointer user_data);
+
+/**
+ * XfceRcIter:
+ *
+ * An opaque structure that walks the groups of an #XfceRc, or the entries
+ * of one group, without copying any names. It is usually allocated on the
+ * stack and initialized with xfce_rc_iter_init_groups() or
+ * xfce_rc_iter_init_entries().
+ *
+ * Since: 4.21.0
+ **/
+struct _XfceRcIter
+{
+  /*< private >*/
+  gpointer dummy1;
+  gpointer dummy2;
+  gpointer dummy3;
+  gpointer dummy4;
+  gint dummy5;
+};
+
+/**
+ * XfceRcParser:
+ * @group        : (nullable): called for each group header, with the name
+ *                 of the group.
+ * @entry        : (nullable): called for each untranslated entry, with its
+ *                 key and unescaped value.
+ * @locale_entry : (nullable): called for each translated entry, like
+ *                 `Name[de]=...`, with its key, locale and unescaped value.
+ *
+ * The callbacks xfce_rc_parse_file() and xfce_rc_parse_data() invoke while
+ * they read a file, in the order the lines appear in it. Entries before
+ * the first group header belong to the default group. Any callback may be
+ * %NULL, and any callback may return %FALSE to stop parsing right away.
+ *
+ * The strings passed to the callbacks are only valid during the call.
+ *
+ * Since: 4.21.0
+ **/
+struct _XfceRcParser
+{
+  gboolean (*group) (const gchar *name,
+                     gpointer user_data);
+  gboolean (*entry) (const gchar *key,
+                     const gchar *value,
+                     gpointer user_data);
+  gboolean (*locale_entry) (const gchar *key,
+                            const gchar *locale,
+                            const gchar *value,
+                            gpointer user_data);
+
+  /*< private >*/
+  gpointer padding[4];
+};
+
+/**
+ * XfceRcStats:
+ * @bytes_parsed   : bytes of rc text tokenized.
+ * @lines_parsed   : lines of rc text tokenized.
+ * @groups         : groups created, by parsing or xfce_rc_set_group().
+ * @entries        : untranslated entries created.
+ * @locale_entries : translated entries created.
+ * @string_bytes   : bytes copied into string chunks, including overwritten
+ *                   values.
+ * @parse_usec     : wall time spent parsing files and loading compiled
+ *                   images, in microseconds.
+ * @flushes        : files written by xfce_rc_flush().
+ * @bytes_flushed  : bytes written by xfce_rc_flush().
+ * @flush_usec     : wall time spent in xfce_rc_flush(), in microseconds.
+ * @lookups        : calls that looked up an entry, e.g. xfce_rc_read_entry()
+ *                   or xfce_rc_has_entry().
+ * @lookup_steps   : list nodes these lookups visited besides the hash lookup:
+ *                   files of an xfce_rc_config_open() handle probed, and
+ *                   translations compared to find the best one.
+ *
+ * Counters of the work an #XfceRc did, see xfce_rc_get_stats().
+ *
+ * Since: 4.21.0
+ **/
+struct _XfceRcStats
+{
+  guint64 bytes_parsed;
+  guint64 lines_parsed;
+  guint64 groups;
+  guint64 entries;
+  guint64 locale_entries;
+  guint64 string_bytes;
+  guint64 parse_usec;
+  guint64 flushes;
+  guint64 bytes_flushed;
+  guint64 flush_usec;
+  guint64 lookups;
+  guint64 lookup_steps;
+
+  /*< private >*/
+  guint64 padding[8];
+};
 
 #define XFCE_TYPE_RC (xfce_rc_get_type ())
+#define XFCE_TYPE_RC_SNAPSHOT (xfce_rc_snapshot_get_type ())
 #define XFCE_RC(obj) ((XfceRc *) (obj))
 #define XFCE_RC_CONST(obj) ((const XfceRc *) (obj))
 
+/**
+ * XfceRcSyncMode:
+ * @XFCE_RC_SYNC_NONE : leave writing the data to disk to the kernel.
+ * @XFCE_RC_SYNC_DATA : sync the contents of the file before it replaces the
+ *                      old one, so a crash never leaves an empty file behind.
+ * @XFCE_RC_SYNC_FULL : like @XFCE_RC_SYNC_DATA, and also sync the directory
+ *                      afterwards, so the new file survives a crash as well.
+ *
+ * How much effort xfce_rc_flush() spends to make sure that the written file
+ * is on permanent storage, see xfce_rc_set_sync_mode().
+ *
+ * Since: 4.21.0
+ **/
+typedef enum /*< prefix=XFCE_RC_SYNC_ >*/
+{
+  XFCE_RC_SYNC_NONE = 0,
+  XFCE_RC_SYNC_DATA = 1,
+  XFCE_RC_SYNC_FULL = 2,
+} XfceRcSyncMode;
+
 GType
 xfce_rc_get_type (void);
 
 XfceRc *
 xfce_rc_simple_open (const gchar *filename,
                      gboolean readonly) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT;
+XfceRc *
+xfce_rc_simple_open_lazy (const gchar *filename,
+                          gboolean readonly) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT;
+XfceRc *
+xfce_rc_simple_open_projected (const gchar *filename,
+                               const gchar *const *groups,
+                               const gchar *const *keys) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT;
+GPtrArray *
+xfce_rc_simple_open_many (const gchar *const *filenames,
+                          gboolean readonly) G_GNUC_WARN_UNUSED_RESULT;
+XfceRc *
+xfce_rc_simple_open_from_bytes (GBytes *bytes) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT;
+XfceRc *
+xfce_rc_simple_open_from_stream (GInputStream *stream,
+                                 GCancellable *cancellable,
+                                 GError **error) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT;
 
 XfceRc *
 xfce_rc_config_open (XfceResourceType type,
                      const gchar *resource,
                      gboolean readonly) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT;
 
+gboolean
+xfce_rc_parse_file (const gchar *filename,
+                    const XfceRcParser *parser,
+                    gpointer user_data,
+                    GError **error);
+gboolean
+xfce_rc_parse_data (const gchar *data,
+                    gssize length,
+                    const XfceRcParser *parser,
+                    gpointer user_data);
+
 void
 xfce_rc_close (XfceRc *rc);
 void
 xfce_rc_flush (XfceRc *rc);
 void
+xfce_rc_flush_async (XfceRc *rc,
+                     GCancellable *cancellable,
+                     GAsyncReadyCallback callback,
+                     gpointer user_data);
+gboolean
+xfce_rc_flush_finish (XfceRc *rc,
+                      GAsyncResult *result,
+                      GError **error);
+void
+xfce_rc_set_auto_flush (XfceRc *rc,
+                        guint interval);
+void
+xfce_rc_watch (XfceRc *rc,
+               XfceRcChangedFunc func,
+               gpointer user_data,
+               GDestroyNotify destroy_notify);
+void
+xfce_rc_unwatch (XfceRc *rc);
+void
+xfce_rc_compact (XfceRc *rc);
+gboolean
+xfce_rc_get_stats (XfceRc *rc,
+                   XfceRcStats *stats);
+gboolean
+xfce_rc_get_global_stats (XfceRcStats *stats);
+
+void
+xfce_rc_begin (XfceRc *rc);
+void
+xfce_rc_commit (XfceRc *rc);
+void
 xfce_rc_rollback (XfceRc *rc);
 
+void
+xfce_rc_set_sync_mode (XfceRc *rc,
+                       XfceRcSyncMode mode);
+XfceRcSyncMode
+xfce_rc_get_sync_mode (const XfceRc *rc) G_GNUC_WARN_UNUSED_RESULT;
+
 gboolean
 xfce_rc_is_dirty (const XfceRc *rc) G_GNUC_WARN_UNUSED_RESULT;
 gboolean
@@ -129,6 +321,35 @@ xfce_rc_write_list_entry (XfceRc *rc,
                           gchar **value,
                           const gchar *separator);
 
+void
+xfce_rc_iter_init_groups (XfceRcIter *iter,
+                          const XfceRc *rc);
+void
+xfce_rc_iter_init_entries (XfceRcIter *iter,
+                           const XfceRc *rc,
+                           const gchar *group);
+gboolean
+xfce_rc_iter_next (XfceRcIter *iter,
+                   const gchar **name);
+
+GType
+xfce_rc_snapshot_get_type (void) G_GNUC_CONST;
+
+XfceRcSnapshot *
+xfce_rc_get_snapshot (XfceRc *rc) G_GNUC_WARN_UNUSED_RESULT;
+XfceRcSnapshot *
+xfce_rc_snapshot_ref (XfceRcSnapshot *snapshot);
+void
+xfce_rc_snapshot_unref (XfceRcSnapshot *snapshot);
+gboolean
+xfce_rc_snapshot_has_group (const XfceRcSnapshot *snapshot,
+                            const gchar *group) G_GNUC_WARN_UNUSED_RESULT;
+const gchar *
+xfce_rc_snapshot_lookup (const XfceRcSnapshot *snapshot,
+                         const gchar *group,
+                         const gchar *key,
+                         gboolean translated) G_GNUC_WARN_UNUSED_RESULT;
+
 G_END_DECLS
 
 #endif /* !__XFCE_RC_H__ */
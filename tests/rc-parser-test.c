@@ -0,0 +1,889 @@
+/*-
+ * Copyright (c) 2026 The Xfce development team
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Differential tests of the rc tokenizer.
+ *
+ * A copy of the byte-by-byte tokenizer of libxfce4util 4.20 serves as the
+ * reference. Every file in corpus/ is run through it and the events it
+ * produces are compared with the .expected file next to it, so the
+ * reference itself cannot drift. The library must agree with it: the
+ * events of xfce_rc_parse_data() must be the same, and a writable handle
+ * opened eagerly or lazily must write the same file, translations
+ * included, as the writer of 4.20 would for the entries the events make.
+ *
+ * The same is done for randomly generated input, change the seed with
+ * --seed to reproduce a failure.
+ *
+ * After an intended change of the rc syntax, update the reference below
+ * and the .expected files together.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include <glib/gstdio.h>
+
+#include "libxfce4util/libxfce4util.h"
+
+
+
+/* number of random inputs per run, run with --verbose to see them */
+#define N_RANDOM_INPUTS 1000
+
+/* the group the test adds and removes to make a handle write its file */
+#define DIRTY_GROUP "rc-parser-test"
+
+
+
+typedef struct _Callbacks Callbacks;
+typedef struct _Model Model;
+typedef struct _ModelGroup ModelGroup;
+typedef struct _ModelEntry ModelEntry;
+typedef struct _ModelLocale ModelLocale;
+typedef struct _Token Token;
+
+
+
+/* receive the events of parse_reference(), like XfceRcParser */
+struct _Callbacks
+{
+  gboolean (*group) (const gchar *name,
+                     gpointer user_data);
+  gboolean (*entry) (const gchar *key,
+                     const gchar *value,
+                     gpointer user_data);
+  gboolean (*locale_entry) (const gchar *key,
+                            const gchar *locale,
+                            const gchar *value,
+                            gpointer user_data);
+};
+
+/* what an XfceRcSimple makes of the events, see model_write() */
+struct _Model
+{
+  GPtrArray *groups;
+  GHashTable *index;
+  ModelGroup *current;
+};
+
+struct _ModelGroup
+{
+  /* NULL for the default group */
+  gchar *name;
+  GPtrArray *entries;
+  GHashTable *index;
+};
+
+struct _ModelEntry
+{
+  gchar *key;
+  gchar *value;
+  GPtrArray *locales;
+};
+
+struct _ModelLocale
+{
+  gchar *locale;
+  gchar *value;
+};
+
+struct _Token
+{
+  const gchar *str;
+  gsize len;
+};
+
+
+
+static gchar *tmp_dir = NULL;
+
+
+
+/* appends @string to @dump, with everything that would break the line
+ * based format escaped */
+static void
+dump_string (GString *dump,
+             const gchar *string)
+{
+  const guchar *p;
+
+  for (p = (const guchar *) string; *p != '\0'; ++p)
+    {
+      if (*p == '\\')
+        g_string_append (dump, "\\\\");
+      else if (*p == '\n')
+        g_string_append (dump, "\\n");
+      else if (*p == '\t')
+        g_string_append (dump, "\\t");
+      else if (*p == '\r')
+        g_string_append (dump, "\\r");
+      else if (*p < 0x20 || *p == 0x7f)
+        g_string_append_printf (dump, "\\x%02x", *p);
+      else
+        g_string_append_c (dump, *p);
+    }
+}
+
+
+
+static gboolean
+dump_group (const gchar *name,
+            gpointer user_data)
+{
+  GString *dump = user_data;
+
+  g_string_append (dump, "group\t");
+  dump_string (dump, name);
+  g_string_append_c (dump, '\n');
+
+  return TRUE;
+}
+
+
+
+static gboolean
+dump_entry (const gchar *key,
+            const gchar *value,
+            gpointer user_data)
+{
+  GString *dump = user_data;
+
+  g_string_append (dump, "entry\t");
+  dump_string (dump, key);
+  g_string_append_c (dump, '\t');
+  dump_string (dump, value);
+  g_string_append_c (dump, '\n');
+
+  return TRUE;
+}
+
+
+
+static gboolean
+dump_locale_entry (const gchar *key,
+                   const gchar *locale,
+                   const gchar *value,
+                   gpointer user_data)
+{
+  GString *dump = user_data;
+
+  g_string_append (dump, "locale\t");
+  dump_string (dump, key);
+  g_string_append_c (dump, '\t');
+  dump_string (dump, locale);
+  g_string_append_c (dump, '\t');
+  dump_string (dump, value);
+  g_string_append_c (dump, '\n');
+
+  return TRUE;
+}
+
+
+
+static const Callbacks dump_callbacks = {
+  dump_group,
+  dump_entry,
+  dump_locale_entry,
+};
+
+static const XfceRcParser dump_parser = {
+  dump_group,
+  dump_entry,
+  dump_locale_entry,
+  { NULL, },
+};
+
+
+
+static ModelEntry *
+model_get_entry (Model *model,
+                 const gchar *key,
+                 const gchar *value)
+{
+  ModelEntry *entry;
+
+  entry = g_hash_table_lookup (model->current->index, key);
+  if (entry == NULL)
+    {
+      entry = g_new0 (ModelEntry, 1);
+      entry->key = g_strdup (key);
+      entry->value = g_strdup (value);
+      entry->locales = g_ptr_array_new ();
+      g_ptr_array_add (model->current->entries, entry);
+      g_hash_table_insert (model->current->index, entry->key, entry);
+    }
+
+  return entry;
+}
+
+
+
+static gboolean
+model_group (const gchar *name,
+             gpointer user_data)
+{
+  Model *model = user_data;
+  ModelGroup *group;
+
+  /* the library calls its default group like that */
+  if (strcmp (name, "[NULL]") == 0)
+    {
+      model->current = g_ptr_array_index (model->groups, 0);
+      return TRUE;
+    }
+
+  group = g_hash_table_lookup (model->index, name);
+  if (group == NULL)
+    {
+      group = g_new0 (ModelGroup, 1);
+      group->name = g_strdup (name);
+      group->entries = g_ptr_array_new ();
+      group->index = g_hash_table_new (g_str_hash, g_str_equal);
+      g_ptr_array_add (model->groups, group);
+      g_hash_table_insert (model->index, group->name, group);
+    }
+
+  model->current = group;
+
+  return TRUE;
+}
+
+
+
+static gboolean
+model_entry (const gchar *key,
+             const gchar *value,
+             gpointer user_data)
+{
+  ModelEntry *entry;
+
+  entry = model_get_entry (user_data, key, value);
+  g_free (entry->value);
+  entry->value = g_strdup (value);
+
+  return TRUE;
+}
+
+
+
+static gboolean
+model_locale_entry (const gchar *key,
+                    const gchar *locale,
+                    const gchar *value,
+                    gpointer user_data)
+{
+  ModelLocale *mlocale;
+  ModelEntry *entry;
+  guint n;
+  gint result;
+
+  /* a translation without an untranslated entry creates one with its value */
+  entry = model_get_entry (user_data, key, value);
+
+  /* like simple_add_entry(), look for the locale from the end, and add
+   * it after the first one that sorts before it, or to the end if there
+   * is none */
+  for (n = entry->locales->len; n > 0; --n)
+    {
+      mlocale = g_ptr_array_index (entry->locales, n - 1);
+      result = strcmp (mlocale->locale, locale);
+      if (result == 0)
+        {
+          g_free (mlocale->value);
+          mlocale->value = g_strdup (value);
+          return TRUE;
+        }
+      else if (result < 0)
+        break;
+    }
+  if (n == 0)
+    n = entry->locales->len;
+
+  mlocale = g_new0 (ModelLocale, 1);
+  mlocale->locale = g_strdup (locale);
+  mlocale->value = g_strdup (value);
+  g_ptr_array_insert (entry->locales, n, mlocale);
+
+  return TRUE;
+}
+
+
+
+static const Callbacks model_callbacks = {
+  model_group,
+  model_entry,
+  model_locale_entry,
+};
+
+
+
+static Model *
+model_new (void)
+{
+  Model *model;
+
+  model = g_new0 (Model, 1);
+  model->groups = g_ptr_array_new ();
+  model->index = g_hash_table_new (g_str_hash, g_str_equal);
+
+  model->current = g_new0 (ModelGroup, 1);
+  model->current->entries = g_ptr_array_new ();
+  model->current->index = g_hash_table_new (g_str_hash, g_str_equal);
+  g_ptr_array_add (model->groups, model->current);
+
+  return model;
+}
+
+
+
+/* the escaping of values of libxfce4util 4.20, writing to a GString */
+static void
+reference_write_escaped (const gchar *string,
+                         GString *buffer)
+{
+  const gchar *s;
+
+  /* escape all whitespace at the beginning of the string */
+  for (; *string == ' '; ++string)
+    g_string_append (buffer, "\\ ");
+
+  for (; *string != '\0'; ++string)
+    switch (*string)
+      {
+      case ' ':
+        /* check if any non whitespace characters follow */
+        for (s = string + 1; g_ascii_isspace (*s); ++s)
+          ;
+        if (*s == '\0')
+          {
+            /* need to escape the space */
+            g_string_append (buffer, "\\ ");
+          }
+        else
+          {
+            /* still non-whitespace, no need to escape */
+            g_string_append_c (buffer, ' ');
+          }
+        break;
+
+      case '\n':
+        g_string_append (buffer, "\\n");
+        break;
+
+      case '\t':
+        g_string_append (buffer, "\\t");
+        break;
+
+      case '\r':
+        g_string_append (buffer, "\\r");
+        break;
+
+      case '\\':
+        g_string_append (buffer, "\\\\");
+        break;
+
+      default:
+        g_string_append_c (buffer, *string);
+        break;
+      }
+}
+
+
+
+/* frees @model and returns the file libxfce4util 4.20 would write for it:
+ * groups without entries are left out and the default group has no header */
+static gchar *
+model_write (Model *model)
+{
+  ModelLocale *mlocale;
+  ModelGroup *group;
+  ModelEntry *entry;
+  GString *buffer;
+  guint n, m, l;
+
+  buffer = g_string_new (NULL);
+
+  for (n = 0; n < model->groups->len; ++n)
+    {
+      group = g_ptr_array_index (model->groups, n);
+
+      if (group->entries->len > 0)
+        {
+          if (group->name != NULL)
+            g_string_append_printf (buffer, "[%s]\n", group->name);
+
+          for (m = 0; m < group->entries->len; ++m)
+            {
+              entry = g_ptr_array_index (group->entries, m);
+              g_string_append_printf (buffer, "%s=", entry->key);
+              reference_write_escaped (entry->value, buffer);
+              g_string_append_c (buffer, '\n');
+
+              for (l = 0; l < entry->locales->len; ++l)
+                {
+                  mlocale = g_ptr_array_index (entry->locales, l);
+                  g_string_append_printf (buffer, "%s[%s]=", entry->key, mlocale->locale);
+                  reference_write_escaped (mlocale->value, buffer);
+                  g_string_append_c (buffer, '\n');
+                  g_free (mlocale->locale);
+                  g_free (mlocale->value);
+                  g_free (mlocale);
+                }
+
+              g_ptr_array_free (entry->locales, TRUE);
+              g_free (entry->key);
+              g_free (entry->value);
+              g_free (entry);
+            }
+
+          g_string_append_c (buffer, '\n');
+        }
+
+      g_ptr_array_free (group->entries, TRUE);
+      g_hash_table_destroy (group->index);
+      g_free (group->name);
+      g_free (group);
+    }
+
+  g_ptr_array_free (model->groups, TRUE);
+  g_hash_table_destroy (model->index);
+  g_free (model);
+
+  return g_string_free (buffer, FALSE);
+}
+
+
+
+/* the tokenizer of libxfce4util 4.20, which scanned every line byte by
+ * byte, copied without changes */
+static gboolean
+reference_parse_line (const gchar *line,
+                      const gchar *end,
+                      Token *section,
+                      Token *key,
+                      Token *value,
+                      Token *locale)
+{
+  const gchar *p, *q, *r, *s;
+
+  p = line;
+
+  section->str = NULL;
+  locale->str = NULL;
+  value->str = NULL;
+  key->str = NULL;
+
+  while (p < end && g_ascii_isspace (*p))
+    ++p;
+
+  if (G_UNLIKELY (p == end || *p == '#'))
+    return FALSE;
+
+  if (*p == '[')
+    {
+      for (q = end, ++p; q > p && *(q - 1) != ']'; --q)
+        ;
+      if (G_LIKELY (q > p))
+        {
+          section->str = p;
+          section->len = q - 1 - p;
+          return TRUE;
+        }
+    }
+  else
+    {
+      for (q = p + 1; q < end && *q != '='; ++q)
+        ;
+      if (G_UNLIKELY (q == end))
+        return FALSE;
+
+      r = q + 1;
+
+      for (--q; g_ascii_isspace (*q); --q)
+        ;
+
+      if (G_UNLIKELY (q == p))
+        return FALSE;
+
+      if (*q == ']')
+        {
+          for (s = q - 1; *s != '[' && s > p; --s)
+            ;
+          if (G_UNLIKELY (*s != '['))
+            return FALSE;
+
+          key->str = p;
+          key->len = s - p;
+
+          locale->str = s + 1;
+          locale->len = q - s - 1;
+
+          if (G_UNLIKELY (key->len == 0 || locale->len == 0))
+            return FALSE;
+        }
+      else
+        {
+          key->str = p;
+          key->len = q + 1 - p;
+        }
+
+      while (r < end && g_ascii_isspace (*r))
+        ++r;
+
+      q = end;
+
+      /* "\ " at the end of the string will not be removed */
+      while (q > r && ((g_ascii_isspace (*(q - 1)) && *(q - 2) != '\\') || ((*(q - 1)) == '\r')))
+        --q;
+
+      value->str = r;
+      value->len = q - r;
+
+      return TRUE;
+    }
+
+  return FALSE;
+}
+
+
+
+/* the unescaping of libxfce4util 4.20, copied without changes */
+static void
+reference_unescape (const gchar *string,
+                    gsize len,
+                    GString *buffer)
+{
+  const gchar *end = string + len;
+
+  g_string_truncate (buffer, 0);
+
+  /* unescape \ , \n, \t, \r and \\ */
+  while (string < end)
+    {
+      if (G_UNLIKELY (*string == '\\' && string + 1 < end))
+        {
+          switch (*(string + 1))
+            {
+            case ' ':
+              g_string_append_c (buffer, ' ');
+              break;
+
+            case 'n':
+              g_string_append_c (buffer, '\n');
+              break;
+
+            case 't':
+              g_string_append_c (buffer, '\t');
+              break;
+
+            case 'r':
+              g_string_append_c (buffer, '\r');
+              break;
+
+            case '\\':
+              g_string_append_c (buffer, '\\');
+              break;
+
+            default:
+              g_string_append_c (buffer, '\\');
+              g_string_append_c (buffer, *(string + 1));
+              break;
+            }
+
+          string += 2;
+        }
+      else
+        g_string_append_c (buffer, *string++);
+    }
+}
+
+
+
+/* splits @data into lines like the library and passes the tokens of
+ * each line, as nul-terminated strings, to @callbacks */
+static void
+parse_reference (const gchar *data,
+                 gsize length,
+                 const Callbacks *callbacks,
+                 gpointer user_data)
+{
+  const gchar *end = data + length;
+  const gchar *line;
+  const gchar *next;
+  GString *value_buffer;
+  Token section;
+  Token locale;
+  Token value;
+  Token key;
+  gchar *key_str;
+  gchar *locale_str;
+  gchar *section_str;
+
+  value_buffer = g_string_new (NULL);
+
+  for (line = data; line < end; line = next)
+    {
+      next = memchr (line, '\n', end - line);
+      next = (next != NULL) ? next + 1 : end;
+
+      if (!reference_parse_line (line, next, &section, &key, &value, &locale))
+        continue;
+
+      if (section.str != NULL)
+        {
+          section_str = g_strndup (section.str, section.len);
+          (*callbacks->group) (section_str, user_data);
+          g_free (section_str);
+          continue;
+        }
+
+      key_str = g_strndup (key.str, key.len);
+      reference_unescape (value.str, value.len, value_buffer);
+
+      if (locale.str != NULL)
+        {
+          locale_str = g_strndup (locale.str, locale.len);
+          (*callbacks->locale_entry) (key_str, locale_str, value_buffer->str, user_data);
+          g_free (locale_str);
+        }
+      else
+        {
+          (*callbacks->entry) (key_str, value_buffer->str, user_data);
+        }
+
+      g_free (key_str);
+    }
+
+  g_string_free (value_buffer, TRUE);
+}
+
+
+
+static gchar *
+dump_reference (const gchar *data,
+                gsize length)
+{
+  GString *dump;
+
+  dump = g_string_new (NULL);
+  parse_reference (data, length, &dump_callbacks, dump);
+
+  return g_string_free (dump, FALSE);
+}
+
+
+
+static gchar *
+dump_library (const gchar *data,
+              gsize length)
+{
+  GString *dump;
+
+  dump = g_string_new (NULL);
+  g_assert_true (xfce_rc_parse_data (data, length, &dump_parser, dump));
+
+  return g_string_free (dump, FALSE);
+}
+
+
+
+/* the file a writable handle of a file with @data writes */
+static gchar *
+write_handle (const gchar *data,
+              gsize length,
+              gboolean lazy)
+{
+  gchar *filename;
+  gchar *contents;
+  XfceRc *rc;
+
+  filename = g_build_filename (tmp_dir, "test.rc", NULL);
+  g_assert_true (g_file_set_contents (filename, data, length, NULL));
+
+  if (lazy)
+    rc = xfce_rc_simple_open_lazy (filename, FALSE);
+  else
+    rc = xfce_rc_simple_open (filename, FALSE);
+  g_assert_nonnull (rc);
+
+  /* a file is only written if something changed */
+  xfce_rc_set_group (rc, DIRTY_GROUP);
+  xfce_rc_write_entry (rc, "key", "value");
+  xfce_rc_delete_group (rc, DIRTY_GROUP, FALSE);
+  xfce_rc_close (rc);
+
+  g_assert_true (g_file_get_contents (filename, &contents, NULL, NULL));
+  g_unlink (filename);
+  g_free (filename);
+
+  return contents;
+}
+
+
+
+/* compares what the library makes of @data with the reference */
+static void
+check_data (const gchar *data,
+            gsize length,
+            const gchar *expected)
+{
+  gchar *reference;
+  gchar *library;
+  gchar *handle;
+  Model *model;
+
+  reference = dump_reference (data, length);
+  library = dump_library (data, length);
+  g_assert_cmpstr (library, ==, reference);
+  if (expected != NULL)
+    g_assert_cmpstr (reference, ==, expected);
+  g_free (reference);
+  g_free (library);
+
+  model = model_new ();
+  parse_reference (data, length, &model_callbacks, model);
+  reference = model_write (model);
+
+  handle = write_handle (data, length, FALSE);
+  g_assert_cmpstr (handle, ==, reference);
+  g_free (handle);
+
+  handle = write_handle (data, length, TRUE);
+  g_assert_cmpstr (handle, ==, reference);
+  g_free (handle);
+
+  g_free (reference);
+}
+
+
+
+static void
+test_corpus (gconstpointer user_data)
+{
+  const gchar *name = user_data;
+  gchar *filename;
+  gchar *expected_name;
+  gchar *expected;
+  gchar *contents;
+  gchar *stem;
+  gsize length;
+
+  /* foo.rc is compared with foo.expected */
+  stem = g_strndup (name, strlen (name) - strlen (".rc"));
+  expected_name = g_strconcat (stem, ".expected", NULL);
+  g_free (stem);
+
+  filename = g_test_build_filename (G_TEST_DIST, "corpus", name, NULL);
+  g_assert_true (g_file_get_contents (filename, &contents, &length, NULL));
+  g_free (filename);
+
+  filename = g_test_build_filename (G_TEST_DIST, "corpus", expected_name, NULL);
+  g_assert_true (g_file_get_contents (filename, &expected, NULL, NULL));
+  g_free (filename);
+
+  check_data (contents, length, expected);
+
+  g_free (expected_name);
+  g_free (expected);
+  g_free (contents);
+}
+
+
+
+static void
+test_random (void)
+{
+  /* mostly the characters the tokenizer looks at */
+  static const gchar alphabet[] = "[]=\\#  \t\r\n\nntab01\xc3\xa9";
+  GString *input;
+  gchar *escaped;
+  guint n, i, len;
+
+  input = g_string_new (NULL);
+
+  for (n = 0; n < N_RANDOM_INPUTS; ++n)
+    {
+      g_string_truncate (input, 0);
+      len = g_test_rand_int_range (0, 200);
+      for (i = 0; i < len; ++i)
+        g_string_append_c (input, alphabet[g_test_rand_int_range (0, sizeof (alphabet) - 1)]);
+
+      if (g_test_verbose ())
+        {
+          escaped = g_strescape (input->str, NULL);
+          g_test_message ("input: \"%s\"", escaped);
+          g_free (escaped);
+        }
+
+      check_data (input->str, input->len, NULL);
+    }
+
+  g_string_free (input, TRUE);
+}
+
+
+
+int
+main (int argc, char **argv)
+{
+  const gchar *name;
+  GError *error = NULL;
+  gchar *test_path;
+  gchar *path;
+  GDir *dir;
+  gint result;
+
+  g_test_init (&argc, &argv, NULL);
+
+  /* writable handles only keep translations with a language set */
+  g_setenv ("LANGUAGE", "de", TRUE);
+
+  tmp_dir = g_dir_make_tmp ("rc-parser-test-XXXXXX", &error);
+  g_assert_no_error (error);
+
+  path = g_test_build_filename (G_TEST_DIST, "corpus", NULL);
+  dir = g_dir_open (path, 0, &error);
+  g_assert_no_error (error);
+
+  while ((name = g_dir_read_name (dir)) != NULL)
+    if (g_str_has_suffix (name, ".rc"))
+      {
+        test_path = g_strconcat ("/rc/parser/corpus/", name, NULL);
+        g_test_add_data_func_full (test_path, g_strdup (name), test_corpus, g_free);
+        g_free (test_path);
+      }
+
+  g_dir_close (dir);
+  g_free (path);
+
+  g_test_add_func ("/rc/parser/random", test_random);
+
+  result = g_test_run ();
+
+  g_rmdir (tmp_dir);
+  g_free (tmp_dir);
+
+  return result;
+}